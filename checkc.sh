@@ -5,7 +5,10 @@ DIR1="."
 DIR2="test"
 
 # Files to check
-FILES=("course_example.am" "course_example.ob" "course_example.ent" "course_example.ext" "invalid_01.am" "invalid_02.am")
+FILES=("course_example.am" "course_example.ob" "course_example.ent" "course_example.ext" "invalid_01.am" "invalid_02.am" "macro_cycle.txt" "params_count.txt" "params_list.txt" "rept_errors.txt" "cond_endif.txt" "cond_else.txt" "cond_missing.txt" "macro_lib_damaged.txt")
+
+# Files that must not be created
+MISSING=("macro_cycle.am" "macro_cycle.ob" "params_count.am" "params_count.ob" "params_list.am" "params_list.ob" "rept_errors.ob" "cond_endif.am" "cond_endif.ob" "cond_else.am" "cond_else.ob" "cond_missing.am" "cond_missing.ob" "macro_lib_damaged.ob")
 
 # Flag to track if all files are identical
 all_identical=true
@@ -28,6 +31,16 @@ for file in "${FILES[@]}"; do
     compare_files "$DIR1/$file" "$DIR2/$file"
 done
 
+# Check that the files that failed created no output
+for file in "${MISSING[@]}"; do
+    if [ -e "$DIR1/$file" ]; then
+        echo "$DIR1/$file should not exist."
+        all_identical=false
+    else
+        echo "$DIR1/$file does not exist."
+    fi
+done
+
 # Print overall result
 if $all_identical; then
     echo "Success: All files are identical."
@@ -5,7 +5,7 @@ DIR1="."
 DIR2="tests/valid_tests"
 
 # Files to check
-FILES=("double_macro.ob" "double_macro.am" "valid_01.am" "valid_01.as" "valid_01.ob" "valid_02.as" "valid_02.am" "valid_02.ob" "valid_02.ent" "valid_02.ext")
+FILES=("double_macro.ob" "double_macro.am" "valid_01.am" "valid_01.as" "valid_01.ob" "valid_02.as" "valid_02.am" "valid_02.ob" "valid_02.ent" "valid_02.ext" "macro_tokens.am" "macro_tokens.ob" "macro_lib_use.as" "macro_lib_use.am" "macro_lib_use.ob" "conditional.as" "conditional.am" "conditional.ob" "rept.as" "rept.am" "rept.ob" "params.as" "params.am" "params.ob" "nested.as" "nested.am" "nested.ob" "single_pass.as" "single_pass.am" "single_pass.ob" "single_pass.ent" "single_pass.ext")
 
 # Flag to track if all files are identical
 all_identical=true
@@ -0,0 +1,5 @@
+; a .else without .ifdef
+MAIN: inc r1
+.else
+prn #1
+stop
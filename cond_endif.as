@@ -0,0 +1,7 @@
+; a .endif without .ifdef
+MAIN: inc r1
+.ifdef DEBUG
+prn #1
+.endif
+.endif
+stop
@@ -0,0 +1,7 @@
+; a .ifndef without .endif
+MAIN: inc r1
+.ifndef DEBUG
+prn #1
+.else
+prn #2
+stop
@@ -10,159 +10,172 @@
 #include "main.h"
 #include "errors.h"
 #include "helpers.h"
+#include "preprocessor.h"
 
 /**
  * @description This function attempts to insert a new label into an existing label array, provided the label meets the necessary criteria and is not a duplicate.
  *
+ * @param context The context of the file that is being assembled.
  * @param label The label data intended for insertion.
  * @param line The associated line data which includes the label.
  * @return A pointer to the newly added label in the label array, or NULL if the label is invalid or already present.
  */
-labelInfo *insertLabelIfValid(labelInfo label, lineInfo *line);
+labelInfo *insertLabelIfValid(assemblerContext *context, labelInfo label, lineInfo *line);
 
 /**
- * @brief Inserts a value into the data array if space permits.
- *
- * @param num The value to insert.
- * @param IC A pointer to the instruction counter.
- * @param DC A pointer to the data counter.
- * @param lineNum The current line number used for error messages.
- * @return TRUE if the value was successfully inserted, FALSE if there is insufficient space.
- */
-boolean insertValueIntoDataArray(int num, int *IC, int *DC, int lineNum);
-
-/**
- * @brief Finds and processes a label in a line of assembly code.
+ * @brief Reads the label token of a line, if there is one, and adds the label.
  *
+ * @param context The context of the file that is being assembled.
  * @param line The line information containing the potential label.
+ * @param tokens The tokens of the line.
  * @param IC The instruction counter.
- * @return A pointer to the next character after the label in the line, or NULL if no label is found.
  */
-char *findLabel(lineInfo *line, int IC);
+void findLabel(assemblerContext *context, lineInfo *line, lineTokens *tokens, int IC);
 
 /**
  * @brief Removes the last added label from the label array and prints a warning.
  *
+ * @param context The context of the file that is being assembled.
  * @param lineNum The line number where the label was found (used for warning message).
  */
-void removeLastLabel(int lineNum);
+void removeLastLabel(assemblerContext *context, int lineNum);
 
 /**
  * @brief Parses a .data directive and adds its values to the data array.
  *
+ * @param context The context of the file that is being assembled.
  * @param line The line information containing the .data directive.
+ * @param tokens The tokens of the line, from the first operand.
  * @param IC A pointer to the instruction counter.
  * @param DC A pointer to the data counter.
  */
-void parseDataDirc(lineInfo *line, int *IC, int *DC);
+void parseDataDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens, int *IC, int *DC);
 
 /**
  * @brief Parses a .string directive and adds its values to the data array.
  *
+ * @param context The context of the file that is being assembled.
  * @param line The line information containing the .string directive.
+ * @param tokens The tokens of the line, from the operand.
  * @param IC A pointer to the instruction counter.
  * @param DC A pointer to the data counter.
  */
-void parseStringDirc(lineInfo *line, int *IC, int *DC);
+void parseStringDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens, int *IC, int *DC);
 
 /**
  * @brief Parses an .extern directive and adds the label as an external label.
+ * @param context The context of the file that is being assembled.
  * @param line The line information containing the .extern directive.
+ * @param tokens The tokens of the line, from the operand.
  */
-void parseExternDirc(lineInfo *line);
+void parseExternDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens);
 
 /**
  * @brief Parses an .entry directive and adds the label to the entry labels list.
+ * @param context The context of the file that is being assembled.
  * @param line The line information containing the .entry directive.
+ * @param tokens The tokens of the line, from the operand.
  */
-void parseEntryDirc(lineInfo *line);
+void parseEntryDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens);
+
+/**
+ * @brief Looks up a directive name in the perfect hash of the directives.
+ *
+ * @param dircName The directive name, without the '.'.
+ * @return The index of the directive in g_dircArr, or -1 if there is no such directive.
+ */
+int getDircId(char *dircName);
 
 /**
  * @brief Parses a directive and calls the appropriate parsing function.
  *
+ * @param context The context of the file that is being assembled.
  * @param line The line information containing the directive.
+ * @param dircId The index of the directive in g_dircArr, or -1 if there is no such directive.
+ * @param tokens The tokens of the line, from the first operand.
  * @param IC A pointer to the instruction counter.
  * @param DC A pointer to the data counter.
  */
-void parseDirective(lineInfo *line, int *IC, int *DC);
+void parseDirective(assemblerContext *context, lineInfo *line, int dircId, lineTokens *tokens, int *IC, int *DC);
 
 /**
  * @brief Parses and validates operand information.
  *
+ * @param context The context of the file that is being assembled.
  * @param operand The operand information to be parsed and validated.
+ * @param token The operand token, typed by the lexer.
  * @param lineNum The line number (used for error reporting).
  */
-void parseOpInfo(operandInfo *operand, int lineNum);
+void parseOpInfo(assemblerContext *context, operandInfo *operand, lineToken *token, int lineNum);
 
 /**
  * @brief Parses and validates the operands for a command.
  *
  * This function parses and validates the operands for a given command. It checks if the operands
  * are legal and updates the instruction counter (IC) accordingly.
+ * @param context The context of the file that is being assembled.
  * @param line The line information containing the command and operands.
+ * @param tokens The tokens of the line, from the first operand.
  * @param IC A pointer to the instruction counter.
  * @param DC A pointer to the data counter.
  */
-void parseCmdOperands(lineInfo *line, int *IC, int *DC);
+void parseCmdOperands(assemblerContext *context, lineInfo *line, lineTokens *tokens, int *IC, int *DC);
 
 /**
- * @brief Parses a command and its operands.
+ * @brief Adds the memory words of a command to the instruction counter.
  *
- * This function identifies and parses a command in a line, extracts and validates its operands,
- * and updates the instruction counter (IC) accordingly.
- * @param line The line information containing the command and operands.
+ * The number of words is read from g_instructionWords by the addressing modes of the operands.
+ * @param line The line information containing the operands.
  * @param IC A pointer to the instruction counter.
  * @param DC A pointer to the data counter.
+ * @return TRUE if the words fit in the memory, FALSE otherwise (IC is then set to the end of the memory).
  */
-void parseCommand(lineInfo *line, int *IC, int *DC);
+boolean reserveInstructionWords(lineInfo *line, int *IC, int *DC);
 
 /**
- * @brief Allocates memory for a string and copies its content.
+ * @brief Parses a command and its operands.
  *
- * This function allocates memory for a new string and copies the content of the input string
- * to the newly allocated memory.
- * @param str The input string to be copied.
- * @return A pointer to the newly allocated and copied string.
+ * This function identifies and parses a command in a line, extracts and validates its operands,
+ * and updates the instruction counter (IC) accordingly.
+ * @param context The context of the file that is being assembled.
+ * @param line The line information containing the command and operands.
+ * @param cmdId The index of the command in g_opArr, or -1 if there is no such command.
+ * @param tokens The tokens of the line, from the first operand.
+ * @param IC A pointer to the instruction counter.
+ * @param DC A pointer to the data counter.
  */
-char *allocString(const char *str);
+void parseCommand(assemblerContext *context, lineInfo *line, int cmdId, lineTokens *tokens, int *IC, int *DC);
 
 /**
  * @brief Parses a line of assembly code.
  *
- * This function parses a line of assembly code, identifies labels, directives, and commands,
+ * This function splits the line into tokens once, identifies labels, directives, and commands,
  * and updates the instruction counter (IC) and data counter (DC) accordingly.
+ * @param context The context of the file that is being assembled.
  * @param line The line information structure to be filled.
- * @param lineStr The input line string to be parsed.
+ * @param lineStr The input line string to be parsed, it is kept (and changed) in place.
  * @param lineNum The line number (used for error reporting).
  * @param IC A pointer to the instruction counter.
  * @param DC A pointer to the data counter.
  */
-void parseLine(lineInfo *line, char *lineStr, int lineNum, int *IC, int *DC);
-
-/**
- * @brief Reads a line from a file.
- *
- * This function reads a line from a file, ensuring the line does not exceed the maximum length.
- * If the line is too long, it reads until the end of the line or file.
- * @param file The file pointer to read from.
- * @param line_data The buffer to store the read line.
- * @param maxLength The maximum length of the line to read.
- * @return Returns TRUE if a line is successfully read, otherwise FALSE.
- */
-boolean readLine(FILE *file, char *line_data, size_t maxLength);
+void parseLine(assemblerContext *context, lineInfo *line, char *lineStr, int lineNum, int *IC, int *DC);
 
 /**
  * @brief Performs the first pass of the assembler.
  *
- * This function performs the first pass of the assembler, reading and parsing each line of the source file.
- * It updates the instruction counter (IC), data counter (DC), and line information array (linesArr).
- * @param file The file pointer to the source file.
- * @param linesArr The array to store parsed line information.
- * @param linesFound A pointer to the number of lines found.
+ * This function performs the first pass of the assembler, reading and parsing each line of the preprocessed source,
+ * with the .rept blocks expanded by the line generator.
+ * It updates the instruction counter (IC), data counter (DC), the labels and the entry labels.
+ * The valid instructions are added to the instruction table, which is the input of the second pass.
+ * In single pass mode they are written to the memory instead, and their label operands get fixups.
+ * @param context The context of the file that is being assembled.
+ * @param source The preprocessed source text, as produced by the macro stage. The lines are kept in it.
+ * @param instructions The instruction table that receives the valid instructions, NULL in single pass mode.
+ * @param fixups The fixup list of single pass mode, NULL to fill the instruction table.
  * @param IC A pointer to the instruction counter.
  * @param DC A pointer to the data counter.
  * @return Returns the number of errors found during the first pass.
  */
-int firstPass(FILE *file, lineInfo *linesArr, int *linesFound, int *IC, int *DC);
+int firstPass(assemblerContext *context, char *source, instructionTable *instructions, fixupList *fixups, int *IC, int *DC);
 
 #endif
\ No newline at end of file
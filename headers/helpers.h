@@ -7,81 +7,219 @@
 #include "errors.h"
 
 /**
- * Duplicates a string by allocating memory and copying the original string.
+ * Duplicates a string into a memory arena.
+ * @param memory The arena to allocate from.
  * @param original The original string to be duplicated.
  * @return A pointer to the newly allocated and duplicated string.
  */
-char *stringDuplicate(const char *original);
+char *arenaStringDuplicate(memoryArena *memory, const char *original);
 
 /**
- * Adds a new MacroNode to the beginning of a linked list.
- * @param head A pointer to the head of the linked list.
- * @param name The name to be stored in the new MacroNode.
- * @param content The content to be stored in the new MacroNode.
- * @param line The line number associated with the MacroNode.
+ * Calculates the FNV-1a hash of a string.
+ * @param str The string to hash, it doesn't have to be null-terminated.
+ * @param length The number of chars to hash.
+ * @return The hash value of the string.
  */
-void addToTheList(MacroNode **head, char *name, char *content, int line);
+unsigned long hashString(const char *str, size_t length);
 
 /**
- * Frees all nodes in a linked list.
- * @param head A pointer to the head of the linked list to be freed.
+ * Initializes an empty macro table.
+ * @param table The macro table to initialize.
+ * @param memory The arena that holds the table, it is freed together with the arena.
  */
-void freeList(MacroNode *head);
+void initMacroTable(macroTable *table, memoryArena *memory);
 
 /**
- * Searches for a label in the global label array and returns a pointer to it if found.
+ * Doubles the number of buckets in a macro table and moves every macro to its new bucket.
+ * @param table The macro table to grow.
+ */
+void growMacroTable(macroTable *table);
+
+/**
+ * Searches for a macro by its name in a macro table.
+ * @param table The macro table to search in.
+ * @param name The name of the macro, it doesn't have to be null-terminated.
+ * @param length The length of the name.
+ * @return A pointer to the macro if found, NULL otherwise.
+ */
+MacroNode *findMacro(macroTable *table, const char *name, size_t length);
+
+/**
+ * Adds a macro to a macro table. A macro that is already in the table takes the new content.
+ * The macro has no parameters and its template is left empty.
+ * @param table The macro table to add to.
+ * @param name The name of the macro.
+ * @param content The content of the macro.
+ * @param line The line number associated with the macro.
+ * @return The macro in the table.
+ */
+MacroNode *addMacro(macroTable *table, char *name, char *content, int line);
+
+/**
+ * Links a macro node into a macro table without copying it.
+ * The name of the node must not be in the table already.
+ * @param table The macro table to add to.
+ * @param node The macro node, its memory must live as long as the table.
+ */
+void insertMacroNode(macroTable *table, MacroNode *node);
+
+/**
+ * Initializes an empty intern table.
+ * @param table The intern table to initialize.
+ * @param memory The arena that holds the table, it is freed together with the arena.
+ */
+void initInternTable(internTable *table, memoryArena *memory);
+
+/**
+ * Finds the slot of a name in an intern table.
+ * @param table The intern table.
+ * @param name The name.
+ * @return The slot of the name, or the empty slot where it would be added.
+ */
+int findNameSlot(internTable *table, char *name);
+
+/**
+ * Doubles the number of slots of an intern table and moves the IDs to their new slots.
+ * @param table The intern table to grow.
+ */
+void growInternTable(internTable *table);
+
+/**
+ * Looks up the ID of a name without adding it.
+ * @param table The intern table.
+ * @param name The name.
+ * @return The ID of the name, or -1 if it has none.
+ */
+int findNameId(internTable *table, char *name);
+
+/**
+ * Returns the ID of a name, giving it the next ID if it is new.
+ * @param table The intern table.
+ * @param name The name, it is copied to the arena of the table.
+ * @return The ID of the name.
+ */
+int internName(internTable *table, char *name);
+
+/**
+ * Initializes an empty label table.
+ * @param table The label table to initialize.
+ * @param memory The arena that holds the table, it is freed together with the arena.
+ */
+void initLabelTable(labelTable *table, memoryArena *memory);
+
+/**
+ * Makes room for a name ID in the byId array of a label table.
+ * @param table The label table.
+ * @param nameId The ID of the name in the intern table of the labels.
+ */
+void reserveLabelId(labelTable *table, int nameId);
+
+/**
+ * Returns the label of a name ID, and adds an undefined label for a name that wasn't used yet.
+ * The pointer is the handle of the label for the rest of the file, the definition fills the same label.
+ * @param table The label table.
+ * @param nameId The ID of the name in the intern table of the labels.
+ * @return A pointer to the label, it stays valid until the arena of the table is reset.
+ */
+labelInfo *bindLabel(labelTable *table, int nameId);
+
+/**
+ * Defines a label in a label table, with a copy of the given label. The name ID must not be defined already.
+ * @param table The label table to add to.
+ * @param label The label to add.
+ * @return A pointer to the label in the table, it stays valid until the arena of the table is reset.
+ */
+labelInfo *addLabel(labelTable *table, labelInfo *label);
+
+/**
+ * Removes a label from a label table, it becomes undefined again.
+ * @param table The label table.
+ * @param label The label in the table.
+ */
+void removeLabel(labelTable *table, labelInfo *label);
+
+/**
+ * Returns the label of a name ID in the label table of a context.
+ * @param context The context of the file that is being assembled.
+ * @param nameId The ID of the name in the names of the context.
+ * @return A pointer to the label if it is defined, NULL otherwise.
+ */
+labelInfo *getLabelById(assemblerContext *context, int nameId);
+
+/**
+ * Searches for a label in the label table of a context and returns a pointer to it if found.
+ * @param context The context of the file that is being assembled.
  * @param labelName The name of the label to search for.
  * @return A pointer to the label if found, NULL otherwise.
  */
-labelInfo *getLabel(char *labelName);
+labelInfo *getLabel(assemblerContext *context, char *labelName);
 
 /**
- * Searches for a command in the global command array and returns its ID if found.
- * @param cmdName The name of the command to search for.
- * @return The ID of the command if found, -1 otherwise.
+ * Initializes an empty instruction table.
+ * @param table The instruction table to initialize.
+ * @param memory The arena that holds the arrays of the table.
  */
-int getCmdId(char *cmdName);
+void initInstructionTable(instructionTable *table, memoryArena *memory);
 
 /**
- * Handles unexpected crashes by cleaning up resources.
- * @param args_count The number of arguments provided.
- * @param ... Variable arguments: strings ("%s") followed by their pointers, and FILE pointers.
+ * Doubles the capacity of all the arrays of an instruction table.
+ * @param table The instruction table.
  */
-void unexpectedCrash(int args_count, ...);
+void growInstructionTable(instructionTable *table);
 
 /**
- * Removes leading spaces from a string.
- * @param ptStr A pointer to the string to be trimmed.
+ * Adds a parsed command line to the end of an instruction table.
+ * @param table The instruction table.
+ * @param line The line of the command, without errors.
  */
-void trimLeftStr(char **ptStr);
+void addInstruction(instructionTable *table, lineInfo *line);
 
 /**
- * Removes leading and trailing spaces from a string.
- * @param ptStr A pointer to the string to be trimmed.
+ * Adds a label to the entry labels of a context, which grow as needed, unless the label is already an entry.
+ * @param context The context of the file that is being assembled.
+ * @param label The label of the directive.
+ * @param lineNum The line of the directive.
+ * @return TRUE if the label was added, FALSE if it is already an entry.
  */
-void trimStr(char **ptStr);
+boolean addEntryLabel(assemblerContext *context, labelInfo *label, int lineNum);
 
 /**
- * Returns the first token in a string and updates the end of the token.
- * @param str The input string.
- * @param endOfTok A pointer to update with the end of the token.
- * @return A pointer to the start of the first token.
+ * Initializes an empty fixup list.
+ * @param list The fixup list to initialize.
+ * @param memoryArr The memory the instruction words are written to.
+ * @param memory The arena that holds the fixups.
  */
-char *getFirstTok(char *str, char **endOfTok);
+void initFixupList(fixupList *list, machineWord *memoryArr, memoryArena *memory);
 
 /**
- * Checks if a string contains only one word.
- * @param str The input string.
- * @return TRUE if the string contains only one word, FALSE otherwise.
+ * Adds a label operand word to the end of a fixup list, which grows as needed.
+ * @param list The fixup list.
+ * @param wordIndex The index of the word in the memory.
+ * @param label The label of the operand.
+ * @param lineNum The number of the line of the instruction.
  */
-boolean isOneWord(char *str);
+void addFixup(fixupList *list, int wordIndex, labelInfo *label, int lineNum);
 
 /**
- * Checks if a string contains only whitespace characters.
- * @param str The input string.
- * @return TRUE if the string contains only whitespace characters, FALSE otherwise.
+ * Returns the addressing mode of an operand, the index of the tables of the addressing modes.
+ * @param type The OperandType of the operand.
+ * @return The OperandType, or 0 if there is no operand (OP_INVALID).
  */
-boolean isWhiteSpaces(char *str);
+int getOpMode(OperandType type);
+
+/**
+ * Searches for a command in the perfect hash of the commands and returns its ID if found.
+ * @param cmdName The name of the command to search for.
+ * @return The ID of the command if found, -1 otherwise.
+ */
+int getCmdId(char *cmdName);
+
+/**
+ * Handles unexpected crashes by cleaning up resources.
+ * @param args_count The number of arguments provided.
+ * @param ... Variable arguments: strings ("%s") followed by their pointers, and FILE pointers.
+ */
+void unexpectedCrash(int args_count, ...);
 
 /**
  * Checks if a label name is legal.
@@ -93,18 +231,12 @@ boolean isWhiteSpaces(char *str);
 boolean isLegalLabel(char *labelStr, int lineNum, boolean printErrors);
 
 /**
- * Checks if a label exists in the global label array.
+ * Checks if a label exists in the label table of a context.
+ * @param context The context of the file that is being assembled.
  * @param label The label name to check.
  * @return TRUE if the label exists, FALSE otherwise.
  */
-boolean isExistingLabel(char *label);
-
-/**
- * Checks if a label is already defined as an entry label.
- * @param labelName The label name to check.
- * @return TRUE if the label is already defined as an entry label, FALSE otherwise.
- */
-boolean isExistingEntryLabel(char *labelName);
+boolean isExistingLabel(assemblerContext *context, char *label);
 
 /**
  * Checks if a string is a register name and updates the value if it is.
@@ -123,39 +255,15 @@ boolean isRegister(char *str, int *value);
 boolean isIndirectRegister(char *str, int *value);
 
 /**
- * Checks if a line is a comment or empty.
- * @param line A pointer to the line information structure.
- * @return TRUE if the line is a comment or empty, FALSE otherwise.
- */
-boolean isCommentOrEmpty(lineInfo *line);
-
-/**
- * Returns the first operand in a line and updates the end of the operand.
- * @param line The input line.
- * @param endOfOp A pointer to update with the end of the operand.
- * @param foundComma A pointer to update if a comma is found.
- * @return A pointer to the start of the first operand.
+ * The value of every digit char, and 16 for chars that aren't digits.
  */
-char *getFirstOperand(char *line, char **endOfOp, boolean *foundComma);
-
-/**
- * Checks if a command is a directive.
- * @param cmd The command string to check.
- * @return TRUE if the command is a directive, FALSE otherwise.
- */
-boolean isDirective(char *cmd);
-
-/**
- * Checks if a string parameter is a legal string and removes the quotes.
- * @param strParam A pointer to the string parameter.
- * @param lineNum The line number for error reporting.
- * @return TRUE if the string parameter is legal, FALSE otherwise.
- */
-boolean isLegalStringParam(char **strParam, int lineNum);
+extern const unsigned char g_digitValues[256];
 
 /**
  * Checks if a number string is a legal number and updates its value.
- * @param numStr The number string to check.
+ * The number is parsed and its range is checked in the same scan, decimal, "0x" hexadecimal and "0" octal
+ * numbers are accepted with an optional sign.
+ * @param numStr The number string to check, without spaces around it.
  * @param numOfBits The number of bits for the number.
  * @param lineNum The line number for error reporting.
  * @param value A pointer to update with the number value.
@@ -230,89 +338,199 @@ FILE *openFile(char *name, char *ending, const char *mode);
 
 /**
  * Removes the specified extension from a filename.
+ * @param memory The arena that holds the new string.
  * @param filename The original filename (null-terminated string).
  * @param extension The extension to remove (null-terminated string).
  * @return A new string with the extension removed if found, otherwise the original filename.
- *         The caller is responsible for freeing the returned string.
+ *         It is released with the arena.
  */
-char *stripExtension(char *filename, const char *extension);
+char *stripExtension(memoryArena *memory, char *filename, const char *extension);
 
 /**
- * Creates the object file (.ob) with the given name, instruction count, data count, and memory array.
+ * Creates the object file (.ob) with the given name, instruction count, data count, and the memory image of a context.
+ * @param context The context of the file that is being assembled.
  * @param name The base name of the file.
  * @param IC The instruction count.
  * @param DC The data count.
- * @param memoryArr The memory array containing the data to write.
  */
-void createObjectFile(char *name, int IC, int DC, int *memoryArr);
+void createObjectFile(assemblerContext *context, char *name, int IC, int DC);
 
 /**
  * Creates the entries file (.ent) with the given name, containing addresses for entry labels.
+ * @param context The context of the file that is being assembled.
  * @param name The base name of the file.
  */
-void createEntriesFile(char *name);
+void createEntriesFile(assemblerContext *context, char *name);
+
+/**
+ * Writes a reference to a label to the extern file if the label is external, the file is created on the first reference.
+ * @param context The context of the file that is being assembled.
+ * @param file The extern file, or NULL if it wasn't created yet.
+ * @param name The base name of the file.
+ * @param label The label of the operand, NULL if the operand isn't a label.
+ * @param address The address of the word that refers to the label.
+ * @return The extern file, or NULL if it wasn't created yet.
+ */
+FILE *writeExternReference(assemblerContext *context, FILE *file, char *name, labelInfo *label, int address);
 
 /**
  * Creates the extern file (.ext) with the given name, containing addresses for extern label operands.
+ * @param context The context of the file that is being assembled.
  * @param name The base name of the file.
- * @param linesArr The array of line information structures.
- * @param linesCount The number of lines found.
+ * @param instructions The instructions of the file, NULL in single pass mode.
+ * @param fixups The fixups of the file in single pass mode, NULL otherwise.
+ */
+void createExternFile(assemblerContext *context, char *name, instructionTable *instructions, fixupList *fixups);
+
+/**
+ * Initializes an empty assembler context, with its own arena, names, labels and entries.
+ * Contexts don't share any state, so every thread can assemble a file with its own context.
+ * @param context The context to initialize.
  */
-void createExternFile(char *name, lineInfo *linesArr, int linesCount);
+void initContext(assemblerContext *context);
 
 /**
- * Resets all global variables and frees all allocated memory blocks.
- * @param linesArr The array of line information structures.
- * @param linesCount The number of lines found.
- * @param dataCount The number of data items.
+ * Empties an assembler context for the next file, the arena is reset in one step with the labels and names.
+ * @param context The context to reset.
  */
-void clearData(lineInfo *linesArr, int linesCount, int dataCount);
+void resetContext(assemblerContext *context);
+
+/**
+ * Releases all the memory of an assembler context.
+ * @param context The context to free.
+ */
+void freeContext(assemblerContext *context);
 
 /**
  * Creates a new file name by replacing the extension of the original file name with a new extension.
+ * @param memory The arena that holds the new file name.
  * @param file_name The original file name.
  * @param new_extension The new extension to append to the file name.
- * @return A pointer to the newly allocated string containing the new file name.
+ * @return A pointer to the new file name, it is released with the arena.
+ */
+char *addNewFile(memoryArena *memory, char *file_name, char *new_extension);
+
+/**
+ * Initializes an empty text buffer.
+ * @param buffer The text buffer to initialize.
+ */
+void initTextBuffer(textBuffer *buffer);
+
+/**
+ * Appends a string to the end of a text buffer, growing it when needed.
+ * @param buffer The text buffer to append to.
+ * @param str The string to append.
  */
-char *addNewFile(char *file_name, char *new_extension);
+void appendToTextBuffer(textBuffer *buffer, const char *str);
 
 /**
- * Copies the contents of one file to another.
- * @param file_name_dest The name of the destination file.
- * @param file_name_orig The name of the source file.
- * @return Returns 1 if the file copy is successful, otherwise returns 0.
+ * Appends a number of chars to the end of a text buffer, growing it when needed.
+ * @param buffer The text buffer to append to.
+ * @param str The chars to append, they don't have to be null-terminated.
+ * @param length The number of chars to append.
  */
-int copyFile(char *file_name_dest, char *file_name_orig);
+void appendCharsToTextBuffer(textBuffer *buffer, const char *str, size_t length);
 
+/**
+ * Empties a text buffer without freeing its memory.
+ * @param buffer The text buffer to empty.
+ */
+void clearTextBuffer(textBuffer *buffer);
+
+/**
+ * Frees the memory held by a text buffer.
+ * @param buffer The text buffer to free.
+ */
+void freeTextBuffer(textBuffer *buffer);
+
+/**
+ * Writes the contents of a text buffer to a file.
+ * @param file_name The name of the destination file.
+ * @param buffer The text buffer to write.
+ * @return Returns 1 if the file was written, otherwise returns 0.
+ */
+int writeTextBufferToFile(char *file_name, textBuffer *buffer);
+
+/**
+ * Initializes an empty line map.
+ * @param map The line map to initialize.
+ * @param memory The arena that holds the lines of the map.
+ */
+void initLineMap(lineMap *map, memoryArena *memory);
+
+/**
+ * Adds the source line number of the next line of a text to a line map, which grows as needed.
+ * @param map The line map.
+ * @param lineNum The number of the line in the source file.
+ */
+void addLineToMap(lineMap *map, int lineNum);
 
 /*********************
-****Text Handling*****
+***Memory Handling****
 *********************/
 
 /**
- * This function checks if a character is either a tab or a space.
- * @param c The character that is being.
- * @return 1 if the character is a tab or space, otherwise return 0.
+ * Initializes an empty memory arena.
+ * @param memory The arena to initialize.
  */
-int tabOrSpaceCheck(char c);
+void initArena(memoryArena *memory);
+
+/**
+ * Allocates memory from an arena, taking a new block when the current one is full.
+ * @param memory The arena to allocate from.
+ * @param size The number of bytes to allocate.
+ * @return A pointer to the allocated memory, aligned for any type.
+ */
+void *arenaAllocate(memoryArena *memory, size_t size);
+
+/**
+ * Allocates memory from an arena and fills it with zeros.
+ * @param memory The arena to allocate from.
+ * @param size The number of bytes to allocate.
+ * @return A pointer to the allocated memory.
+ */
+void *arenaAllocateZeroed(memoryArena *memory, size_t size);
+
+/**
+ * Releases all the allocations of an arena at once, keeping a single block for reuse.
+ * @param memory The arena to reset.
+ */
+void resetArena(memoryArena *memory);
+
+/**
+ * Frees all the blocks of an arena.
+ * @param memory The arena to free.
+ */
+void freeArena(memoryArena *memory);
+
+/*********************
+****Text Handling*****
+*********************/
 
 /**
- * This function removes white spaces that are before or after commas in a given string.
- * @param str The pointer to where white spaces are found.
+ * The CharKind of every char, used by the white spaces normalizer.
  */
-void removeSpacesNearComma(char *str);
+extern const unsigned char g_charKinds[256];
 
 /**
- * This function removes extra white spaces from a string.
+ * This function removes extra white spaces from a string in a single pass, writing every char once.
+ * Spaces at the start and the end of the line are removed, every other run of spaces becomes a single space,
+ * and spaces next to a comma are removed (unless the line starts with a comma).
  * @param str The string from which extra white spaces will be removed.
+ * @param length The length of the string.
+ * @return The length of the string after the change.
  */
-void removeExtraSpacesString(char str[]);
+size_t removeExtraSpacesString(char str[], size_t length);
 
 /**
- * This function removes all extra unnecessary white spaces from a specified file.
- * @param file_name The name of the file being examined for white spaces.
- * @return The name of the new file after removing extra white spaces.
+ * This function reads the next line of a source file and removes all extra unnecessary white spaces from it.
+ * Comment lines are replaced by an empty line.
+ * @param source_pointer The source file.
+ * @param str The buffer that receives the line, at least LINE_MAX_LENGTH + 2 chars long.
+ * @param line_number The number of the line, for the error message.
+ * @param file_name The name of the source file, for the error message.
+ * @return 1 if a line was read, 0 at the end of the file and -1 if the line is too long.
  */
-char *removeExtraSpacesFile(char file_name[]);
+int readNormalizedLine(FILE *source_pointer, char *str, int line_number, char *file_name);
 
 #endif
\ No newline at end of file
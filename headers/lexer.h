@@ -0,0 +1,84 @@
+/* Name: Almog Hakak, ID: 211825229 */
+
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "main.h"
+#include "helpers.h"
+#include "first_pass.h"
+
+/**
+ * The LexClass of every char, used by the line lexer.
+ */
+extern const unsigned char g_lexClasses[256];
+
+/**
+ * The operand automaton: the next OperandState for every state and LexClass.
+ */
+extern const unsigned char g_operandStates[OPS_STATES][LEX_CLASSES];
+
+/**
+ * The TokenKind of every final state of the operand automaton.
+ */
+extern const TokenKind g_operandKinds[OPS_STATES];
+
+/**
+ * @brief Splits a line into tokens in a single pass over its chars.
+ *
+ * The stream is an optional TOK_LABEL_DEF, a TOK_MNEMONIC or TOK_DIRECTIVE (with an empty text if the line
+ * is only a label), and the operands. The operands are split by commas and a TOK_COMMA follows every operand
+ * that a comma ends, so a comma after the last operand is the last token. Directives whose operand is the whole
+ * rest of the line get a single operand token, even if it is empty.
+ * Every token is ended in place in the line, without the spaces around it.
+ * @param lineStr The line to split, changed in place.
+ * @param tokens The token stream to fill.
+ * @return The kind of the line, the tokens are only filled for LINE_CODE.
+ */
+LineKind tokenizeLine(char *lineStr, lineTokens *tokens);
+
+/**
+ * @brief Reads a single operand and types it with the operand automaton.
+ *
+ * @param cursor The start of the operand, spaces before it are skipped.
+ * @param stopAtComma Whether a comma ends the operand or is a part of it.
+ * @param token Receives the operand token.
+ * @param foundComma Set to TRUE if a comma ended the operand.
+ * @return The char after the operand and the comma that ended it.
+ */
+char *tokenizeOperand(char *cursor, boolean stopAtComma, lineToken *token, boolean *foundComma);
+
+/**
+ * @brief Adds a token to the end of a token stream.
+ *
+ * @param tokens The token stream.
+ * @param kind The kind of the token.
+ * @param str The text of the token.
+ * @param value The value of the token.
+ */
+void addToken(lineTokens *tokens, TokenKind kind, char *str, int value);
+
+/**
+ * @brief Returns the next token of a stream without reading it.
+ *
+ * @param tokens The token stream.
+ * @return The next token, or NULL if all the tokens were read.
+ */
+lineToken *peekToken(lineTokens *tokens);
+
+/**
+ * @brief Reads the next token of a stream.
+ *
+ * @param tokens The token stream.
+ * @return The next token, or NULL if all the tokens were read.
+ */
+lineToken *nextToken(lineTokens *tokens);
+
+/**
+ * @brief Reads the next token of a stream if it is a comma.
+ *
+ * @param tokens The token stream.
+ * @return TRUE if a comma was read, FALSE otherwise.
+ */
+boolean acceptComma(lineTokens *tokens);
+
+#endif
@@ -13,15 +13,40 @@
 #define RAM_LIMIT 4096
 #define NUM_OF_REG 7
 #define WORD_LENGTH 15
+#define WORD_MASK ((1 << WORD_LENGTH) - 1)
+#define ARE_BITS 3 /* The ARE kind is in the low bits of every word, the rest of the word is shifted over it. */
+#define VALUE_MASK ((1 << (WORD_LENGTH - ARE_BITS)) - 1)
+#define DEST_MODE_SHIFT 3
+#define SRC_MODE_SHIFT 7
+#define OPCODE_SHIFT 11
+#define DEST_REG_SHIFT 3
+#define SRC_REG_SHIFT 6
+#define REG_MASK 7
 #define BYTE_LENGTH 8
 #define BASE_OCTAL 8
 #define BASE_DECIMAL 10
 #define INITIAL_ADDRESS 100 
 #define LABEL_MAX_LENGTH 31
-#define LINES_MAX_LENGTH 300
-#define LABELS_MAX LINES_MAX_LENGTH
 #define LINE_MAX_LENGTH 80
 #define FILENAME_MAX_LENGTH 256
+#define MACRO_TABLE_INITIAL_SIZE 64
+#define LABEL_TABLE_INITIAL_SIZE 64
+#define INTERN_TABLE_INITIAL_SIZE 128
+#define ENTRY_LABELS_INITIAL_SIZE 16
+#define INSTRUCTION_TABLE_INITIAL_SIZE 64
+#define FIXUP_LIST_INITIAL_SIZE 64
+#define LINE_MAP_INITIAL_SIZE 256
+#define MACRO_SEGMENTS_INITIAL_SIZE 8
+#define OP_HASH_SIZE 32
+#define DIRC_HASH_SIZE 8
+#define LINE_TOKENS_MAX (2 * LINE_MAX_LENGTH + 2) /* A label, a command and an operand and a comma for every char. */
+#define ARENA_BLOCK_SIZE 65536
+#define CONDITIONAL_MAX_DEPTH 32
+#define REPEAT_MAX_DEPTH 32
+#define REPEAT_LINES_MAX (64 * RAM_LIMIT)
+#define MACRO_PARAMS_MAX 10
+#define MACRO_LIBRARY_MAGIC "AML2"
+#define MACRO_LIBRARY_NUMBER_SIZE 4
 #define SINGLE_DIGIT 1
 #define DOUBLE_DIGIT 2
 #define TRIPLE_DIGIT 3
@@ -29,6 +54,9 @@
 #define FALSE 0
 #define TRUE 1
 #define INFINITE_LOOP for(;;)
+#define ARENA_ALIGNMENT sizeof(arenaAlign)
+#define ARENA_HEADER_SIZE ((sizeof(arenaBlock) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT)
+#define SPACES_WORD (~0UL / 0xFF * ' ') /* An unsigned long with a space in every byte. */
 
 /* A R E type as bits*/
 typedef enum { 
@@ -37,6 +65,9 @@ typedef enum {
     ARE_ABS = 4           /* Absolute */
 } AREKind;
 
+/* A memory word of WORD_LENGTH bits. C89 has no uint16_t, but an unsigned short has at least 16 bits. */
+typedef unsigned short machineWord;
+
 /* Numbers as bit flags corresponding to each operand type. */
 typedef enum { 
     OP_NUMERIC = 1,       /* Numeric operand */
@@ -46,12 +77,102 @@ typedef enum {
     OP_INVALID = -1       /* Invalid operand */
 } OperandType; 
 
+#define OP_MODES (OP_REGULAR_REG + 1) /* The tables of the addressing modes go from 0 (no operand) to OP_REGULAR_REG. */
+#define OP_ALL_MODES (OP_NUMERIC | OP_LABEL | OP_INDIRECT_REG | OP_REGULAR_REG)
+#define OP_TARGET_MODES (OP_LABEL | OP_INDIRECT_REG | OP_REGULAR_REG) /* The modes that can be written to. */
+#define OP_REGISTER_MODES (OP_INDIRECT_REG | OP_REGULAR_REG) /* The modes that are encoded in the register bits. */
+
+/* Kinds of chars for the white spaces normalizer. */
+typedef enum {
+    CHAR_TEXT = 0,        /* Copied as is. */
+    CHAR_SPACE = 1,       /* White space other than a new line. */
+    CHAR_COMMA = 2,       /* Comma, the spaces around it are removed. */
+    CHAR_END = 3          /* New line or the end of the string. */
+} CharKind;
+
+/* Kinds of chars for the line lexer. */
+typedef enum {
+    LEX_OTHER = 0,        /* Any other char. */
+    LEX_SPACE,            /* White space. */
+    LEX_END,              /* The end of the line. */
+    LEX_COMMA,            /* ',' between operands. */
+    LEX_COLON,            /* ':' after a label. */
+    LEX_LETTER,           /* A letter other than 'r'. */
+    LEX_R,                /* 'r', starts a register. */
+    LEX_REG_DIGIT,        /* A digit that is a register number. */
+    LEX_DIGIT,            /* Any other digit. */
+    LEX_HASH,             /* '#' before a number. */
+    LEX_STAR,             /* '*' before an indirect register. */
+    LEX_CLASSES           /* The number of kinds. */
+} LexClass;
+
+/* States of the operand automaton of the lexer. */
+typedef enum {
+    OPS_EMPTY = 0,        /* Nothing was read yet. */
+    OPS_IMMEDIATE,        /* '#' and anything after it. */
+    OPS_STAR,             /* '*' */
+    OPS_STAR_R,           /* '*r' */
+    OPS_INDIRECT_REG,     /* '*r' and a register number. */
+    OPS_R,                /* 'r' */
+    OPS_REGISTER,         /* 'r' and a register number. */
+    OPS_IDENTIFIER,       /* A letter and then letters and digits. */
+    OPS_INVALID,          /* None of the above. */
+    OPS_STATES            /* The number of states. */
+} OperandState;
+
+/* Kinds of the tokens of a line. */
+typedef enum {
+    TOK_LABEL_DEF = 0,    /* The label before the ':'. */
+    TOK_MNEMONIC,         /* The command name. */
+    TOK_DIRECTIVE,        /* The directive name, without the '.'. */
+    TOK_REGISTER,         /* r0 - r7 */
+    TOK_INDIRECT_REG,     /* *r0 - *r7 */
+    TOK_IMMEDIATE,        /* '#' and a number. */
+    TOK_IDENTIFIER,       /* A label operand. */
+    TOK_STRING,           /* A quoted string, the value is its length without the quotes. */
+    TOK_COMMA,            /* ',' */
+    TOK_EMPTY,            /* An operand with no text. */
+    TOK_INVALID           /* An operand that is none of the above. */
+} TokenKind;
+
+/* Kinds of lines for the lexer. */
+typedef enum {
+    LINE_EMPTY = 0,       /* An empty line or a comment. */
+    LINE_BAD_COMMENT,     /* A comment that doesn't start at the start of the line. */
+    LINE_CODE             /* A line with tokens. */
+} LineKind;
+
+/* Conditional assembly directives. */
+typedef enum {
+    COND_NONE = 0,        /* Not a conditional directive. */
+    COND_IFDEF,           /* .ifdef symbol */
+    COND_IFNDEF,          /* .ifndef symbol */
+    COND_ELSE,            /* .else */
+    COND_ENDIF            /* .endif */
+} ConditionalKind;
+
+/* Results of reading a line from the line generator. */
+typedef enum {
+    GEN_END = 0,          /* No more lines. */
+    GEN_LINE,             /* A line to parse. */
+    GEN_LONG_LINE,        /* A line that is too long. */
+    GEN_ERROR             /* A wrong .rept or .endr, the error was printed. */
+} GeneratorStatus;
+
+/* Expansion states of a macro. */
+typedef enum {
+    MACRO_RAW = 0,        /* The content may still call other macros. */
+    MACRO_EXPANDING,      /* The calls in the content are being expanded. */
+    MACRO_EXPANDED        /* The content and the template are fully expanded. */
+} MacroState;
+
 typedef unsigned int boolean; /* TRUE or FALSE values */
 
 /* Directive Structure */
 typedef struct {
     char *name;          /* Directive name. */
     void (*parseFunc)(); /* Function pointer to the function that parses this directive. */
+    boolean isWholeOperand; /* The operand is the rest of the line, not a list split by commas. */
 } directive;
 
 /* Command Structure */
@@ -60,69 +181,234 @@ typedef struct
     char *name;              /* Command name. */
     unsigned int opcode : 4; /* opcode uses 4 bits. */
     int numOfParams;         /* Number of parameters  */
+    unsigned char srcModes;  /* The legal OperandType flags of the source operand. */
+    unsigned char destModes; /* The legal OperandType flags of the destination operand. */
 } command;
 
+/* Arena Block Structure - header of a memory block, its data comes right after it. */
+typedef struct arenaBlock {
+    struct arenaBlock *next; /* The block that was used before this one. */
+    size_t size;             /* Number of bytes of data in the block. */
+    size_t used;             /* Number of bytes of data that were handed out. */
+} arenaBlock;
+
+/* Memory Arena Structure - allocations that are released together. */
+typedef struct {
+    arenaBlock *head; /* The block that allocations are taken from. */
+} memoryArena;
+
+/* Type with the strictest alignment that the arena has to keep. */
+typedef union {
+    long l;
+    double d;
+    void *p;
+} arenaAlign;
+
+/* Macro Segment Structure - a piece of a macro template. */
+typedef struct {
+    char *text;                 /* Literal text of the segment, a part of the macro content. */
+    int length;                 /* Number of chars in the text. */
+    int param;                  /* Index of the parameter that comes after the text, or -1. */
+} macroSegment;
+
 /* Macro Node Structure */
 typedef struct macroNode{
     char *name;                 /* Macro identifier. */
     int line;                   /* Line number where the macro is declared. */
     char *content;              /* Macro definition. */
-    struct macroNode *next;     /* Link to the next macro node. */
+    char *params;               /* Parameter names separated by commas. */
+    MacroState state;           /* Whether the calls in the content were expanded. */
+    int numParams;              /* Number of parameters of the macro. */
+    int numSegments;            /* Number of segments in the template. */
+    macroSegment *segments;     /* The content, split at the uses of the parameters. */
+    struct macroNode *calling;  /* The macro whose call is being expanded in the content, while it is MACRO_EXPANDING. */
+    struct macroNode *next;     /* Link to the next macro in the same bucket. */
 } MacroNode;
 
+/* Macro Table Structure - macros indexed by a hash of their name. */
+typedef struct {
+    MacroNode **buckets; /* Chains of the macros that share a hash. */
+    int size;            /* Number of buckets, always a power of 2. */
+    int count;           /* Number of macros in the table. */
+    memoryArena *memory; /* The arena that holds the buckets and the macros. */
+} macroTable;
+
+/* Macro Matcher Structure - an automaton over all the macro names of a file. */
+typedef struct {
+    int charClass[256];  /* Column of each char in the transitions, 0 for chars that aren't in any name. */
+    int numClasses;      /* Number of columns in the transitions. */
+    int *transitions;    /* Next state for each state and char class, 0 when there is none. */
+    MacroNode **accept;  /* The macro whose name ends at each state, or NULL. */
+    memoryArena *memory; /* The arena that holds the automaton and the expanded macros. */
+} macroMatcher;
+
+/* Macro Library Structure - precompiled macros that are shared by all the files that follow it. */
+typedef struct {
+    memoryArena memory;   /* Holds the image of the library file, the table and the matcher. */
+    macroTable table;     /* The macros, their names and contents point into the image. */
+    macroMatcher matcher; /* The automaton of the library names, for files without macros of their own. */
+} macroLibrary;
+
+/* Conditional Stack Structure - the .ifdef and .ifndef blocks that are open at a line. */
+typedef struct {
+    int depth;                                /* Number of open blocks. */
+    int line[CONDITIONAL_MAX_DEPTH];          /* Line of the directive that opened each block. */
+    boolean elseSeen[CONDITIONAL_MAX_DEPTH];  /* Whether the .else of each block was read. */
+} conditionalStack;
+
+/* Repeat Frame Structure - a .rept block that is being expanded. */
+typedef struct {
+    char *start;      /* First line of the body in the source text. */
+    int startLine;    /* Line number of the first line of the body. */
+    long remaining;   /* Number of times the body is read again after the current one. */
+} repeatFrame;
+
+/* Line Generator Structure - reads the lines of the preprocessed source, with the .rept blocks expanded. */
+typedef struct {
+    char *cursor;                         /* Next line in the source text. */
+    int lineNum;                          /* Line number of the last line that was read. */
+    int depth;                            /* Number of .rept blocks that are being expanded. */
+    long repeatedLines;                   /* Lines read so far for the outermost .rept block. */
+    repeatFrame frames[REPEAT_MAX_DEPTH]; /* The .rept blocks that are being expanded, innermost last. */
+    char repeatedLine[LINE_MAX_LENGTH + 2]; /* The copy of the body line that is being parsed, every repetition reuses it. */
+} lineGenerator;
+
+/* Text Buffer Structure - growable in-memory text. */
+typedef struct {
+    char *data;      /* The text, always null-terminated. */
+    size_t length;   /* Number of chars in use (without the null). */
+    size_t capacity; /* Number of chars allocated for data. */
+} textBuffer;
+
+/* Line Map Structure - the line in the source file of every line of a preprocessed text. */
+typedef struct {
+    int *lines;          /* The source line number of every line of the text. */
+    int count;           /* Number of lines. */
+    int capacity;        /* Number of lines that fit in lines. */
+    memoryArena *memory; /* The arena that holds the lines. */
+} lineMap;
+
+/* Template Builder Structure - the template of a macro while the calls in its content are expanded. */
+typedef struct {
+    textBuffer text;                 /* The content without the uses of the parameters. */
+    macroSegment *segments;          /* The segments, their text is set when the template is done. */
+    int numSegments;                 /* Number of segments. */
+    int capacity;                    /* Number of segments that fit in segments. */
+    size_t segmentStart;             /* Offset in the text where the current segment starts. */
+    char *names[MACRO_PARAMS_MAX];   /* The parameter names of the macro, in the params string. */
+    size_t lengths[MACRO_PARAMS_MAX];/* The lengths of the parameter names. */
+    int numParams;                   /* Number of parameters of the macro. */
+    memoryArena *memory;             /* The arena that holds the segments and the content. */
+} templateBuilder;
+
 typedef struct /* Labels Structure */
 {
 	int address; /* The address it contains. */
-	char name[LABEL_MAX_LENGTH]; /* The name of the label. */					
+	int nameId; /* The ID of the name of the label in the names of the context. */
 	boolean isExtern; /* Extern flag. */
 	boolean isData; /* Data flag (.data or .string). */
+	boolean isDefined; /* FALSE for a name that was only used as an operand so far. */
+	int entryLineNum; /* The line of the .entry directive of the label, 0 if it isn't an entry. */
 } labelInfo;
 
+typedef struct /* Intern Table Structure - a small integer ID for every identifier of a file. */
+{
+	char **names; /* The name of every ID. */
+	int count; /* Number of IDs. */
+	int capacity; /* Number of names that fit in names. */
+	int *slots; /* ID + 1 of the names by an open addressing hash of the name, 0 for an empty slot. */
+	int size; /* Number of slots, always a power of 2. */
+	memoryArena *memory; /* The arena that holds the table and the names. */
+} internTable;
+
+typedef struct /* Label Table Structure - labels indexed by the ID of their name. */
+{
+	labelInfo **byId; /* The label of every name ID, NULL for names that were never used as labels. */
+	int idCapacity; /* Number of IDs that fit in byId. */
+	labelInfo **labels; /* The labels in the order they were added. */
+	int count; /* Number of labels. */
+	int capacity; /* Number of labels that fit in labels. */
+	memoryArena *memory; /* The arena that holds the table and the labels. */
+} labelTable;
+
 typedef struct /* Operand Structure */
 {
 	int value; /* Value. */
 	char *str; /* String. */
+	labelInfo *label; /* The label in the labels of the context, bound when the operand is parsed, for OP_LABEL. */
 	OperandType type; /* Type. */
-	int address; /* The address of the operand in the memory. */
 } operandInfo;
 
 typedef struct /* Line Structure */
 {
 	int lineNum; /* The number of the line in the file. */
 	int address; /* The address of the first word in the line. */
-	char *originalString; /* The original pointer, allocated by malloc. */
-	char *lineStr; /* The text it contains (changed while using parseLine). */
+	char *lineStr; /* The text it contains, a view into the preprocessed source (changed while using parseLine). */
 	boolean isError; /* Represent whether there is an error or not. */
-	labelInfo *label; /* A poniter to the lines label in labelArr. */
+	labelInfo *label; /* A poniter to the lines label in the labels of the context. */
 	char *commandStr; /* The string of the command or directive. */
 	const command *cmd;	/* A pointer to the command in g_opArr. */
 	operandInfo op1; /* The 1st operand. */
 	operandInfo op2; /* The 2nd operand. */
 } lineInfo;
 
-typedef struct /* Memory Word Structure - 15 bits */
+typedef struct /* Instruction Table Structure - the instructions of a file as parallel arrays, the input of the second pass. */
 {
-	unsigned int are : 3;
-	union /* 12 bits */
-	{
-		struct /* Commands (only 12 bits) */
-		{
-			unsigned int dest : 4; /* Destination op addressing method ID. */
-			unsigned int src : 4; /* Source op addressing method ID. */
-			unsigned int opcode : 4; /* Command ID. */
-		} cmdBits;
-
-		struct /* Registers (only 6 bits) */
-		{
-			unsigned int destBits : 3; /* DEST Register. */
-			unsigned int srcBits : 3; /* SRC Register. */
-		} regBits;
-		/* Other operands */
-		int value : 12; /* (12 bits) */
-
-	} valueBits; /* End of 12 bits union. */
-
-} memoryWord;
+	unsigned char *opcodes; /* The opcode of every instruction. */
+	unsigned char *srcModes; /* The OperandType of the source operand, 0 if there is none. */
+	unsigned char *destModes; /* The OperandType of the destination operand, 0 if there is none. */
+	int *srcValues; /* The register or the number of the source operand. */
+	int *destValues; /* The register or the number of the destination operand. */
+	labelInfo **srcLabels; /* The label of the source operand, NULL if it isn't OP_LABEL. */
+	labelInfo **destLabels; /* The label of the destination operand, NULL if it isn't OP_LABEL. */
+	int *lineNums; /* The number of the line of every instruction in the file. */
+	int *addresses; /* The address of the first word of every instruction. */
+	int count; /* Number of instructions. */
+	int capacity; /* Number of instructions that fit in the arrays. */
+	memoryArena *memory; /* The arena that holds the arrays. */
+} instructionTable;
+
+typedef struct /* Fixup Structure - a label operand word that is written when the address of the label is known. */
+{
+	int wordIndex; /* The index of the word in the memory. */
+	int lineNum; /* The number of the line of the instruction. */
+	labelInfo *label; /* The label of the operand. */
+} fixup;
+
+typedef struct /* Fixup List Structure - the code of a file that is assembled in a single pass. */
+{
+	machineWord *memoryArr; /* The memory the instruction words are written to during the first pass. */
+	fixup *fixups; /* The label operand words, in the order of their addresses. */
+	int count; /* Number of fixups. */
+	int capacity; /* Number of fixups that fit in fixups. */
+	memoryArena *memory; /* The arena that holds the fixups. */
+} fixupList;
+
+typedef struct /* Token Structure */
+{
+	TokenKind kind; /* Kind. */
+	char *str; /* The text of the token, ended in place in the line. */
+	int value; /* The register number, the length of a string, or the index in g_opArr / g_dircArr (-1 if there is none). */
+} lineToken;
+
+typedef struct /* Token Stream Structure - the tokens of a single line. */
+{
+	lineToken tokens[LINE_TOKENS_MAX]; /* The tokens in the order of the line. */
+	int count; /* The number of tokens. */
+	int next; /* The index of the next token to read. */
+} lineTokens;
+
+typedef struct /* Assembler Context Structure - the state of a file that is being assembled, every file (or thread) has its own. */
+{
+	memoryArena memory; /* Everything that is allocated for the file: names, labels, entries, instructions and file names. */
+	internTable names; /* IDs of the identifiers of the file. */
+	labelTable labels; /* Table of the labels of the file. */
+	labelInfo **entryLabels; /* The entry labels, every label once, in the order of the .entry directives. */
+	int entryLabelsCount; /* Number of entry labels. */
+	int entryLabelsCapacity; /* Number of entry labels that fit in entryLabels. */
+	machineWord data[RAM_LIMIT]; /* The data words of the .data and .string directives. */
+	machineWord image[RAM_LIMIT]; /* The memory image of the file, the code followed by the data. */
+} assemblerContext;
 
 /**
  * @brief Declares an external array of `command` structures.
@@ -132,35 +418,24 @@ typedef struct /* Memory Word Structure - 15 bits */
 extern const command g_opArr[];
 
 /**
- * @brief Declares an external array of `labelInfo` structures.
- * This array stores information about labels encountered during the assembly process.
- * Each `labelInfo` structure contains details like the label's address, name, and flags
- * indicating if it is external or associated with data.
- */
-extern labelInfo g_labelsArr[LABELS_MAX];
-
-/**
- * @brief Declares an external array of pointers to `lineInfo` structures.
- * This array holds pointers to lines that define entry labels.
- */
-extern lineInfo *g_entryLinesArr[LABELS_MAX];
-
-/**
- * @brief Declares an external integer variable to track the number of labels.
- * This variable keeps track of the number of labels currently stored in `g_labelsArr`.
+ * @brief Declares the number of memory words of an instruction for every pair of addressing modes.
+ *
+ * The table is indexed by the source and the destination OperandType, 0 if there is no operand.
+ * Two register operands share a single word, so the first pass and the second pass read the size from here.
  */
-extern int g_labelCount;
+extern const unsigned char g_instructionWords[OP_MODES][OP_MODES];
 
 /**
- * @brief Declares an external integer variable to track the number of entry labels.
- * This variable keeps track of the number of entry labels currently stored in `g_entryLinesArr`.
+ * @brief Declares the external array of directives.
+ * This array is defined elsewhere and contains the directive names and their parsing functions.
  */
-extern int g_entryLabelsCount;
+extern const directive g_dircArr[];
 
 /**
- * @brief Declares an external array of integers to store numerical data.
- * This array stores the numerical data values encountered during the assembly process.
+ * @brief Declares the external perfect hash of the command names.
+ * Maps (3 * name[0] + 18 * name[1] + name[2]) % OP_HASH_SIZE to the index of the command in `g_opArr`,
+ * or -1, with no two commands on the same slot.
  */
-extern int g_arr[RAM_LIMIT];
+extern const signed char g_opHash[OP_HASH_SIZE];
 
 #endif
\ No newline at end of file
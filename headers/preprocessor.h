@@ -9,60 +9,108 @@
 
 
 /**
- * @brief Substitutes macro references in the given file with their defined values.
+ * @brief Substitutes macro references in the given text with their defined values.
  *
- * This function iterates through the specified file, identifying and skipping macro definitions.
- * For all other lines, it performs a substitution of macro references with their corresponding definitions from the macro list.
- * The updated lines are written to a temporary file, which then replaces the original file.
- * @param input_file The path to the file that will be processed.
- * @param head The head of the linked list that holds the macro definitions and their replacements.
+ * This function iterates through the lines of the source text, which no longer has the macro definitions,
+ * and performs a substitution of macro references with their corresponding definitions.
+ * The updated lines are appended to the output text.
+ * @param source The text that will be processed.
+ * @param lines The line in the source file of every line of the text, for errors.
+ * @param matcher The automaton of the macro names of the file.
+ * @param output The text buffer that receives the processed lines.
+ * @param file_name The name of the source file, for errors.
+ * @return 1 on success, 0 if a macro was called with wrong arguments.
  */
-void replaceMacroReferences(char *input_file, MacroNode *head);
+int replaceMacroReferences(textBuffer *source, lineMap *lines, macroMatcher *matcher, textBuffer *output, char *file_name);
 
 /**
  * @brief Performs macro substitution on the specified file.
  *
- * This function parses the input file, substitutes macro invocations with their respective
- * definitions, and generates a new .am file containing the modified content.
- * @param file_name The name of the file to be processed.
+ * This function reads the source file once, removes extra white spaces, substitutes macro invocations
+ * with their respective definitions and keeps the result in memory for the first pass.
+ * The .am file is written from the result only when a name for it is given.
+ * The macros of a loaded library are available to the file without reading their definitions again.
+ * @param file_name The name of the source file to be processed.
+ * @param macro_file_name The name of the .am file to create, or NULL to skip it.
+ * @param symbols The symbols that were defined on the command line, for the conditional directives.
+ * @param library The precompiled macro library, or NULL if none was loaded.
+ * @param output The text buffer that receives the processed source.
+ * @param memory The arena of the file, it holds the macros of the file.
  * @return Returns 1 upon successful macro substitution, or 0 if an error occurs.
  */
-int processMacros(char *file_name);
+int processMacros(char *file_name, char *macro_file_name, macroTable *symbols, macroLibrary *library, textBuffer *output, memoryArena *memory);
 
 /**
- * @brief Substitutes a placeholder with its defined content in a given string.
+ * @brief Checks if a character ends a macro reference.
+ * @param c The character to check.
+ * @return 1 if the character can't be a part of a macro name, otherwise 0.
+ */
+int isMacroDelimiter(char c);
+
+/**
+ * @brief Builds the automaton that recognizes the names of all the macros in a library and a table.
+ *
+ * The automaton is a trie over the chars of the names, with a transitions row for every state.
+ * It is built once per file, after all the macros were imported. A macro of the table replaces
+ * a library macro with the same name.
+ * @param matcher The matcher to build.
+ * @param library The macro table of a library, or NULL.
+ * @param table The macro table that holds the macro definitions.
+ * @param memory The arena that holds the automaton, and the macros that are expanded with it.
+ */
+void buildMacroMatcher(macroMatcher *matcher, macroTable *library, macroTable *table, memoryArena *memory);
+
+/**
+ * @brief Runs the macro automaton over a single token.
+ *
+ * Every char of the token is read once, no matter how many macros there are.
+ * @param matcher The automaton of the macro names.
+ * @param token The start of the token.
+ * @param end Set to the first char after the token.
+ * @return The macro whose name is the whole token, or NULL if there is none.
+ */
+MacroNode *matchMacroToken(macroMatcher *matcher, char *token, char **end);
+
+/**
+ * @brief Substitutes the macro references in a line with their defined content.
  *
- * This function looks for a specific placeholder within the input string and substitutes it with the associated content.
- * @param str The string that may contain the placeholder.
- * @param macr Pointer to the MacroNode representing the placeholder and its content.
- * @return A new string with the placeholder substituted, or NULL if the placeholder was not found.
+ * This function scans the line once and runs the macro automaton over every token.
+ * Tokens that name a macro are replaced by its content, text inside strings is never replaced.
+ * The arguments of a macro with parameters are the rest of the line, separated by commas.
+ * @param str The start of the line in the source text.
+ * @param matcher The automaton of the macro names of the file.
+ * @param output The text buffer that receives the line after the substitution.
+ * @param file_name The name of the source file, for errors.
+ * @param lineNum The number of the line in the source file, for errors.
+ * @return A pointer to the start of the next line, or NULL if a macro was called with wrong arguments.
  */
-char *substitutePlaceholder(char *str, MacroNode *macr);
+char *expandMacroReferences(char *str, macroMatcher *matcher, textBuffer *output, char *file_name, int lineNum);
 
 /**
- * @brief Extracts and stores macro content from a file.
+ * @brief Checks if a line starts with a keyword.
  *
- * This function reads macro content from a file starting at the specified position,
- * updates the line count for each line read, and determines the total length of the macro.
- * @param fp Pointer to the file to read from.
- * @param pos Position in the file where reading begins.
- * @param line_count Pointer to the variable tracking the number of lines read.
- * @return Pointer to the allocated memory containing the macro content.
+ * The keyword must be the whole first word of the line.
+ * @param str The line to check, without leading white spaces.
+ * @param keyword The keyword to look for.
+ * @return A pointer to the text after the keyword, or NULL if the line doesn't start with it.
  */
-char *extractMacroData(FILE *fp, fpos_t *pos, int *line_count);
+char *matchLineKeyword(char *str, const char *keyword);
 
 /**
  * @brief Analyzes and processes a macro definition.
  *
  * This function examines the provided string to determine if it conforms to a proper macro definition format.
- * It extracts the macro identifier and allocates memory for it accordingly.
- * @param str The string that potentially contains a macro definition.
+ * It extracts the macro identifier and the list of its parameters ("macr NAME p1,p2"),
+ * and allocates memory for them in the given arena.
+ * @param str The text that comes after the "macr" keyword.
  * @param name Pointer to hold the extracted macro identifier.
+ * @param params Pointer to hold the parameter names, separated by commas, or an empty string.
  * @param line_count The number of the line being processed.
  * @param file_name The name of the file from which the string was read.
+ * @param memory The arena that holds the name and the parameters.
  * @return 1 if the macro definition is correctly formatted, 0 otherwise.
  */
-int analyzeMacroDefinition(char *str, char **name, int line_count, char *file_name);
+int analyzeMacroDefinition(char *str, char **name, char **params, int line_count, char *file_name, memoryArena *memory);
 
 /**
  * @brief Reserves memory and handles allocation errors.
@@ -75,14 +123,250 @@ int analyzeMacroDefinition(char *str, char **name, int line_count, char *file_na
 char *allocateMemory(size_t size);
 
 /**
- * @brief Incorporates macro definitions from a specified file into a list.
+ * @brief Reads a source file and incorporates its macro definitions into a macro table.
  *
- * This function processes a file to extract macro definitions and appends them to the given list.
- * It ensures that each macro definition is properly formatted and stores the associated data.
+ * This function reads the file once, line by line, and removes the extra white spaces of every line.
+ * The lines of a macro definition are collected into the content of the macro, all the other
+ * lines are appended to the source text, so the definitions never have to be read again.
+ * The conditional directives are handled on the way, and their disabled lines are skipped
+ * without being normalized.
  * @param file_name The path to the file to be processed.
- * @param head A pointer to the start of the list.
+ * @param symbols The symbols that were defined on the command line, or NULL.
+ * @param library The loaded macro library, or NULL.
+ * @param table The macro table that receives the definitions.
+ * @param source The text buffer that receives the lines outside of the macro definitions.
+ * @param lines The line map that receives the line number of every line of the source text, or NULL.
  * @return 1 if the operation was successful, 0 otherwise.
  */
-int importMacros(char *file_name, MacroNode **head);
+int importMacros(char *file_name, macroTable *symbols, macroLibrary *library, macroTable *table, textBuffer *source, lineMap *lines);
+
+/**
+ * @brief Writes a number to a macro library file, in a fixed size and byte order.
+ * @param fp The library file.
+ * @param number The number to write.
+ */
+void writeLibraryNumber(FILE *fp, unsigned long number);
+
+/**
+ * @brief Reads a number that was written by writeLibraryNumber.
+ * @param bytes The bytes of the number.
+ * @return The number.
+ */
+unsigned long readLibraryNumber(const unsigned char *bytes);
+
+/**
+ * @brief Compiles the macro definitions of a source file into a macro library file.
+ *
+ * The library holds a name table (offsets of the name and the content, the line and the template of every macro),
+ * the segments of the templates, and the names and the contents, so it can be loaded without parsing anything.
+ * Lines outside of the macro definitions are ignored.
+ * @param file_name The source file with the macro definitions.
+ * @param library_file_name The name of the library file to create.
+ * @param symbols The symbols that were defined on the command line, for the conditional directives.
+ * @param memory The arena that holds the macros while the library is written.
+ * @return 1 if the library was written, 0 otherwise.
+ */
+int compileMacroLibrary(char *file_name, char *library_file_name, macroTable *symbols, memoryArena *memory);
+
+/**
+ * @brief Loads a macro library file that was written by compileMacroLibrary.
+ *
+ * The file is read in one piece, and the macros point into it. The automaton of the library
+ * names is built once, for all the files that use it.
+ * @param library_file_name The name of the library file.
+ * @param library The library to load into, its arena must be initialized. A loaded library is replaced.
+ * @return 1 if the library was loaded, 0 otherwise.
+ */
+int loadMacroLibrary(char *library_file_name, macroLibrary *library);
+
+/**
+ * @brief Checks if a line is a conditional directive (.ifdef, .ifndef, .else or .endif).
+ *
+ * Works on normalized lines and on raw lines with leading white spaces.
+ * @param str The line.
+ * @param args Set to the text after the directive name.
+ * @return The kind of the directive, or COND_NONE.
+ */
+ConditionalKind matchConditional(char *str, char **args);
+
+/**
+ * @brief Checks if a symbol is defined for the conditional directives.
+ *
+ * A symbol is defined if it was given on the command line, or if it is the name of a library macro
+ * or of a macro that was defined earlier in the file.
+ * @param name The symbol name, not null-terminated.
+ * @param length The length of the name.
+ * @param symbols The command line symbols, or NULL.
+ * @param library The loaded macro library, or NULL.
+ * @param table The macros of the file.
+ * @return 1 if the symbol is defined, otherwise 0.
+ */
+int isSymbolDefined(char *name, size_t length, macroTable *symbols, macroLibrary *library, macroTable *table);
+
+/**
+ * @brief Skips the disabled lines of a conditional block.
+ *
+ * The raw lines are only checked for conditional directives, to follow nested blocks.
+ * They aren't normalized and their length isn't limited.
+ * @param fp The source file, positioned after the directive that disabled the lines.
+ * @param line_count The line counter, advanced by the skipped lines.
+ * @return COND_ELSE or COND_ENDIF of the block, or COND_NONE at the end of the file.
+ */
+ConditionalKind skipDisabledLines(FILE *fp, int *line_count);
+
+/**
+ * @brief Handles a conditional directive that was read in the enabled lines.
+ *
+ * Updates the open blocks and skips the lines that the directive disables.
+ * @param fp The source file.
+ * @param kind The kind of the directive.
+ * @param args The text after the directive name.
+ * @param conditionals The open conditional blocks.
+ * @param line_count The line counter, the line of the directive on entry.
+ * @param file_name The name of the source file, for errors.
+ * @param symbols The command line symbols, or NULL.
+ * @param library The loaded macro library, or NULL.
+ * @param table The macros of the file.
+ * @return 1 on success, 0 if the directive is wrong.
+ */
+int processConditional(FILE *fp, ConditionalKind kind, char *args, conditionalStack *conditionals, int *line_count,
+                       char *file_name, macroTable *symbols, macroLibrary *library, macroTable *table);
+
+/**
+ * @brief Measures the identifier at the start of a text.
+ * @param str The text.
+ * @return The number of letters, digits and underscores at the start of the text.
+ */
+size_t macroTokenLength(char *str);
+
+/**
+ * @brief Starts the template of a macro.
+ * @param builder The template builder to initialize.
+ * @param params The parameter names, separated by commas, as checked by analyzeMacroDefinition.
+ * @param memory The arena of the macro table.
+ */
+void initTemplateBuilder(templateBuilder *builder, char *params, memoryArena *memory);
+
+/**
+ * @brief Ends the current segment of a template at the end of its text.
+ * @param builder The template builder.
+ * @param param The index of the parameter that comes after the segment, or -1 for the last segment.
+ */
+void endTemplateSegment(templateBuilder *builder, int param);
+
+/**
+ * @brief Adds text from the content of the macro, or from an argument in it, to a template.
+ *
+ * Every identifier of the text that names a parameter ends a segment, so a call only copies
+ * the segments and the arguments, without scanning the content again.
+ * Text inside strings is never a parameter.
+ * @param builder The template builder.
+ * @param str The text, it doesn't have to be null-terminated.
+ * @param length The number of chars of the text.
+ */
+void appendTemplateText(templateBuilder *builder, char *str, size_t length);
+
+/**
+ * @brief Ends a template and makes it the content and the segments of a macro.
+ *
+ * A macro without parameters has a single segment.
+ * @param builder The template builder, its text buffer is freed.
+ * @param macro The macro.
+ */
+void finishTemplate(templateBuilder *builder, MacroNode *macro);
+
+/**
+ * @brief Prints the error of a macro that calls itself, with the chain of the calls that are being expanded.
+ * @param macro The macro that was reached again.
+ * @param file_name The name of the source file, for errors.
+ */
+void printMacroCycle(MacroNode *macro, char *file_name);
+
+/**
+ * @brief Expands the macros that are called in the content of a macro, and builds its template.
+ *
+ * The called macros are expanded first, to any depth, and every macro is expanded only once,
+ * so a call copies a fully expanded template. The parameters are found in the content of the macro
+ * itself and in the arguments of its calls, never in the content of the called macros.
+ * A macro that calls itself, directly or through other macros, is an error.
+ * @param macro The macro.
+ * @param matcher The automaton of all the macro names that can be called.
+ * @param file_name The name of the source file, for errors.
+ * @return 1 on success, 0 if there is a cycle or a call with wrong arguments.
+ */
+int resolveMacro(MacroNode *macro, macroMatcher *matcher, char *file_name);
+
+/**
+ * @brief Expands all the macros of a table, once it is complete.
+ * @param table The macro table.
+ * @param matcher The automaton of all the macro names that can be called.
+ * @param file_name The name of the source file, for errors.
+ * @return 1 on success, 0 if a macro can't be expanded.
+ */
+int resolveMacros(macroTable *table, macroMatcher *matcher, char *file_name);
+
+/**
+ * @brief Reads the arguments of a macro call.
+ * @param str The text after the macro name.
+ * @param args Set to the start of every argument.
+ * @param lengths Set to the length of every argument.
+ * @param end Set to the end of the arguments, the end of the line.
+ * @return The number of arguments, or -1 if an argument is empty or there are more than MACRO_PARAMS_MAX.
+ */
+int readMacroArguments(char *str, char **args, size_t *lengths, char **end);
+
+/**
+ * @brief Adds the expansion of a macro to the output, with the arguments in place of the parameters.
+ * @param output The text buffer that receives the expansion.
+ * @param macro The macro.
+ * @param args The arguments of the call.
+ * @param lengths The lengths of the arguments.
+ */
+void appendMacroExpansion(textBuffer *output, MacroNode *macro, char **args, size_t *lengths);
+
+/**
+ * @brief Starts reading the lines of a preprocessed source text.
+ * @param generator The line generator to initialize.
+ * @param source The preprocessed source text.
+ */
+void initLineGenerator(lineGenerator *generator, char *source);
+
+/**
+ * @brief Reads the count of a .rept directive.
+ * @param str The text after ".rept".
+ * @return The count, or -1 if it isn't a number between 0 and RAM_LIMIT.
+ */
+long parseRepeatCount(char *str);
+
+/**
+ * @brief Moves the line generator over the next line of the source text, without changing it.
+ * @param generator The line generator.
+ * @param length Set to the length of the line, without the \n.
+ * @return The start of the line.
+ */
+char *readGeneratorLine(lineGenerator *generator, size_t *length);
+
+/**
+ * @brief Moves the line generator after the .endr of a .rept block that isn't expanded.
+ * @param generator The line generator, positioned after the .rept line.
+ * @return TRUE if the .endr was found, FALSE at the end of the source.
+ */
+boolean skipRepeatBody(lineGenerator *generator);
+
+/**
+ * @brief Reads the next line for the first pass, expanding the .rept blocks on the way.
+ *
+ * The body of a ".rept N" ... ".endr" block is read N times from the single copy in the source,
+ * so a large block is never copied as a whole. Lines outside of the blocks are ended in place,
+ * and every repetition of a body line is copied into a single line buffer of the generator, so the
+ * memory doesn't grow with the number of repetitions. The line is valid until the next call.
+ * An outermost block that reads more than REPEAT_LINES_MAX lines, counting its nested blocks, is
+ * stopped with an error and the reading continues after it.
+ * @param generator The line generator.
+ * @param lineStr Set to the line, for GEN_LINE.
+ * @param lineNum Set to the line number in the preprocessed source.
+ * @return GEN_LINE, GEN_LONG_LINE, GEN_ERROR after printing an error, or GEN_END.
+ */
+GeneratorStatus nextSourceLine(lineGenerator *generator, char **lineStr, int *lineNum);
 
 #endif
\ No newline at end of file
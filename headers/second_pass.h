@@ -14,76 +14,65 @@
 /**
  * @brief Updates the addresses of data labels by adding the instruction counter (IC) value.
  *
- * This function iterates through the global label array and updates the address of each data label
+ * This function iterates through the labels of the context and updates the address of each data label
  * by adding the value of the instruction counter (IC). This is necessary for adjusting data labels
  * after the instruction section has been processed.
+ * @param context The context of the file that is being assembled.
  * @param IC The instruction counter value to be added to the data labels' addresses.
  */
-void updateDataLabelsAddress(int IC);
+void updateDataLabelsAddress(assemblerContext *context, int IC);
 
 /**
  * @brief Counts the number of illegal entry labels and reports errors.
  *
- * This function iterates through the global entry lines array and checks each entry label.
+ * This function iterates through the entry labels of the context and checks each entry label once.
  * It reports errors if an entry label is found to be an external label or if the label does not exist.
  * The function returns the total number of errors found.
+ * @param context The context of the file that is being assembled.
  * @return The total number of errors found in the entry labels.
  */
-int countIllegalEntries();
+int countIllegalEntries(assemblerContext *context);
 
 /**
- * @brief Updates the address of a label operand.
+ * @brief Resolves a label operand to the address of the label.
  *
- * This function checks if the operand is of type OP_LABEL. If so, it retrieves the label information
- * and updates the operand's value with the label's address. If the label does not exist, an error is reported.
- * @param op A pointer to the operand information to be updated.
+ * This function uses the label the operand was bound to in the first pass, without looking it up again.
+ * If the label was never defined, an error is reported.
+ * @param context The context of the file that is being assembled.
+ * @param label The label of the operand, NULL if the operand isn't a label.
+ * @param value A pointer to the operand value, it receives the label address.
+ * @param are Receives the ARE type of the operand word.
  * @param lineNum The line number where the operand is located (used for error reporting).
- * @return Returns TRUE if the label exists and the address was updated, otherwise FALSE.
+ * @return Returns TRUE if the operand isn't a label or the label is defined, otherwise FALSE.
  */
-boolean updateLabelOpAddress(operandInfo *op, int lineNum);
+boolean resolveLabelOperand(assemblerContext *context, labelInfo *label, int *value, AREKind *are, int lineNum);
 
 /**
- * @brief Extracts the numerical value from a memory word.
+ * @brief Creates a memory word for a command.
  *
- * This function applies a bitmask to the value in a memory word to extract the relevant bits.
- * It combines the value bits and the ARE (Addressing, Relocatable, External) bits into a single integer.
- * @param memory The memory word to extract the value from.
- * @return The extracted numerical value from the memory word.
- */
-int getNumFromMemoryWord(memoryWord memory);
-
-/**
- * @brief Retrieves the type ID of an operand.
- *
- * This function checks if the operand type is valid and returns its type ID.
- * If the operand type is invalid, it returns 0.
- * @param op The operand information.
- * @return The type ID of the operand if valid, otherwise 0.
- */
-int getOpTypeId(operandInfo op);
-
-/**
- * @brief Creates a memory word for a command line.
- *
- * This function creates and initializes a memory word for a given command line.
- * It sets the ARE type to ARE_ABS and encodes the destination and source operand types and the opcode.
+ * This function shifts the fields of a command into a word: the opcode, the source and destination
+ * operand types and ARE_ABS, from the high bits to the low bits.
  *
- * @param line The line information containing the command and operands.
+ * @param opcode The opcode of the command.
+ * @param srcMode The OperandType of the source operand, 0 if there is none.
+ * @param destMode The OperandType of the destination operand, 0 if there is none.
  * @return The created memory word for the command.
  */
-memoryWord getCmdMemoryWord(lineInfo line);
+machineWord getCmdMemoryWord(int opcode, int srcMode, int destMode);
 
 /**
  * @brief Creates a memory word for an operand.
  *
- * This function creates and initializes a memory word for a given operand.
- * It sets the ARE type and encodes the operand value based on its type (register, indirect register, label, or number).
+ * This function shifts the fields of an operand into a word, with the ARE type in the low bits.
+ * Registers are encoded in the source or destination register bits, numbers and label addresses in the value bits.
  *
- * @param op The operand information.
+ * @param mode The OperandType of the operand.
+ * @param value The register, the number or the label address.
+ * @param are The ARE type of the word.
  * @param isDest A flag indicating if the operand is a destination operand.
  * @return The created memory word for the operand.
  */
-memoryWord getOpMemoryWord(operandInfo op, boolean isDest);
+machineWord getOpMemoryWord(int mode, int value, AREKind are, boolean isDest);
 
 /**
  * @brief Adds a memory word to the memory array.
@@ -95,44 +84,78 @@ memoryWord getOpMemoryWord(operandInfo op, boolean isDest);
  * @param memoryCounter A pointer to the current memory counter.
  * @param memory The memory word to add.
  */
-void addWordToMemory(int *memoryArr, int *memoryCounter, memoryWord memory);
+void addWordToMemory(machineWord *memoryArr, int *memoryCounter, machineWord memory);
 
 /**
- * @brief Adds a line to the memory array, updating operand addresses as needed.
+ * @brief Adds an instruction to the memory image of the context, resolving its label operands.
  *
- * This function adds the memory words for a line to the memory array, updating the addresses of label operands.
- * It handles different operand types (register, indirect register, label, number) and adds the appropriate memory words.
- * @param memoryArr The memory array to add the line to.
+ * This function adds the memory words of an instruction to the memory image. Two register operands
+ * share a single word, otherwise every operand gets its own word after the command word.
+ * @param context The context of the file that is being assembled.
  * @param memoryCounter A pointer to the current memory counter.
- * @param line A pointer to the line information.
+ * @param instructions The instruction table.
+ * @param index The index of the instruction in the table.
  * @return Returns TRUE if no error was found, otherwise FALSE.
  */
-boolean addLineToMemory(int *memoryArr, int *memoryCounter, lineInfo *line);
+boolean addInstructionToMemory(assemblerContext *context, int *memoryCounter, instructionTable *instructions, int index);
 
 /**
- * @brief Adds data to the memory array.
+ * @brief Writes an operand word of an instruction in single pass mode.
  *
- * This function adds data words to the memory array, applying a bitmask to each data word.
- * It increments the memory counter for each data word added.
- * @param memoryArr The memory array to add the data to.
+ * A label operand only gets a fixup, its word is written by patchFixups when the address of the label is known.
+ * @param fixups The fixup list, with the memory the words are written to.
+ * @param index The index of the word in the memory.
+ * @param op The operand.
+ * @param isDest A flag indicating if the operand is a destination operand.
+ * @param lineNum The number of the line of the instruction.
+ */
+void emitOperandWord(fixupList *fixups, int index, operandInfo *op, boolean isDest, int lineNum);
+
+/**
+ * @brief Writes the memory words of an instruction during the first pass, in single pass mode.
+ *
+ * The words are written at the address that the first pass reserved for the instruction.
+ * @param fixups The fixup list, with the memory the words are written to.
+ * @param line A valid command line.
+ */
+void emitInstruction(fixupList *fixups, lineInfo *line);
+
+/**
+ * @brief Adds the data of the context to its memory image.
+ *
+ * This function copies the data words after the words in the memory image, the words were masked when they were parsed.
+ * It increments the memory counter by the number of data words added.
+ * @param context The context of the file that is being assembled.
  * @param memoryCounter A pointer to the current memory counter.
  * @param DC The data counter indicating the number of data words.
  */
-void addDataToMemory(int *memoryArr, int *memoryCounter, int DC);
+void addDataToMemory(assemblerContext *context, int *memoryCounter, int DC);
 
 /**
  * @brief Performs the second pass of reading and processing an assembly language file.
  * 
  * This function updates the addresses of data labels, checks for illegal entries,
- * and adds the parsed lines and data to the memory array. It returns the total
+ * and adds the instructions and data to the memory image of the context. It returns the total
  * number of errors encountered during this process.
- * @param memoryArr An array of integers representing the memory of the assembly program.
- * @param linesArr An array of lineInfo structures holding information about each parsed line.
- * @param lineNum The number of lines in the linesArr array.
+ * @param context The context of the file that is being assembled.
+ * @param instructions The valid instructions of the file, in the order of their addresses.
  * @param IC The instruction counter value at the end of the first pass.
  * @param DC The data counter value at the end of the first pass.
  * @return The total number of errors encountered during the second pass.
  */
-int secondPass(int *memoryArr, lineInfo *linesArr, int lineNum, int IC, int DC);
+int secondPass(assemblerContext *context, instructionTable *instructions, int IC, int DC);
+
+/**
+ * @brief Completes the memory of a file that was assembled in single pass mode.
+ *
+ * This function updates the addresses of data labels, checks for illegal entries, writes the label operand
+ * words of the fixups and adds the data to the memory image of the context. The errors are the same as the ones of secondPass.
+ * @param context The context of the file that is being assembled.
+ * @param fixups The fixup list, with the memory the instructions were written to.
+ * @param IC The instruction counter value at the end of the first pass.
+ * @param DC The data counter value at the end of the first pass.
+ * @return The total number of errors encountered.
+ */
+int patchFixups(assemblerContext *context, fixupList *fixups, int IC, int DC);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,11 @@
+; common macros, compiled once with -c macro_lib
+macr inc_both
+inc r1
+inc r2
+endmacr
+macr print_len
+prn LEN
+endmacr
+macr add_to dst,val
+add #val, dst
+endmacr
@@ -0,0 +1,12 @@
+; macro names that are also parts of other words
+macr m
+inc r1
+endmacr
+macr STR2
+prn #1
+endmacr
+mov r3, STR
+STR: .string "m STR2"
+m
+LOOP: STR2
+jmp LOOP
@@ -0,0 +1,18 @@
+; macros with parameters
+macr push reg
+mov reg, r7
+inc r7
+endmacr
+macr set dst,val
+mov #val, dst
+endmacr
+macr show_str str
+prn str
+STR: .string "str"
+endmacr
+MAIN: push r3
+set r2,-5
+set LEN, 4
+show_str LEN
+stop
+LEN: .data 1
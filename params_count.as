@@ -0,0 +1,8 @@
+; calls with a wrong number of arguments
+macr set dst,val
+mov #val, dst
+endmacr
+MAIN: set r1,2
+set r1
+stop
+set r1,2,3
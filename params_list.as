@@ -0,0 +1,6 @@
+; a parameter list with an empty name
+macr set dst,,val
+mov #val, dst
+endmacr
+MAIN: set r1,2
+stop
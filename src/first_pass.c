@@ -4,45 +4,72 @@
 #include "errors.h"
 #include "helpers.h"
 #include "first_pass.h"
+#include "second_pass.h"
+#include "lexer.h"
 
 /* List of Directives */
-void parseDataDirc(lineInfo *line, int *IC, int *DC);
-void parseStringDirc(lineInfo *line, int *IC, int *DC);
-void parseExternDirc(lineInfo *line);
-void parseEntryDirc(lineInfo *line);
+void parseDataDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens, int *IC, int *DC);
+void parseStringDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens, int *IC, int *DC);
+void parseExternDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens);
+void parseEntryDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens);
 
 const directive g_dircArr[] = 
-{	/* Name | Parsing Function */
-	{ "data", parseDataDirc } ,
-	{ "string", parseStringDirc } ,
-	{ "extern", parseExternDirc },
-	{ "entry", parseEntryDirc },
+{	/* Name | Parsing Function | Whole Operand */
+	{ "data", parseDataDirc, FALSE } ,
+	{ "string", parseStringDirc, TRUE } ,
+	{ "extern", parseExternDirc, TRUE },
+	{ "entry", parseEntryDirc, TRUE },
 	{ NULL } /* This value will represent the end of the array. */
 };	
 
+/* Perfect hash of the directive names: (name[1] + name[2]) % DIRC_HASH_SIZE -> index in g_dircArr, or -1. */
+const signed char g_dircHash[DIRC_HASH_SIZE] = { -1, -1, 3, -1, 2, 0, 1, -1 };
+
 /* List of Commands form of Name, opcode, params */
 const command g_opArr[] =	
 {
-	{ "mov", 0, 2 } , 
-	{ "cmp", 1, 2 } ,
-	{ "add", 2, 2 } ,
-	{ "sub", 3, 2 } ,
-	{ "lea", 4, 2 } ,
-	{ "clr", 5, 1 } ,
-	{ "not", 6, 1 } ,
-	{ "inc", 7, 1 } ,
-	{ "dec", 8, 1 } ,
-	{ "jmp", 9, 1 } ,
-	{ "bne", 10, 1 } ,
-	{ "red", 11, 1 } ,
-	{ "prn", 12, 1 } ,
-	{ "jsr", 13, 1 } ,
-	{ "rts", 14, 0 } ,
-	{ "stop", 15, 0 } ,
+	{ "mov", 0, 2, OP_ALL_MODES, OP_TARGET_MODES } , 
+	{ "cmp", 1, 2, OP_ALL_MODES, OP_ALL_MODES } ,
+	{ "add", 2, 2, OP_ALL_MODES, OP_TARGET_MODES } ,
+	{ "sub", 3, 2, OP_ALL_MODES, OP_TARGET_MODES } ,
+	{ "lea", 4, 2, OP_LABEL, OP_TARGET_MODES } ,
+	{ "clr", 5, 1, 0, OP_TARGET_MODES } ,
+	{ "not", 6, 1, 0, OP_TARGET_MODES } ,
+	{ "inc", 7, 1, 0, OP_TARGET_MODES } ,
+	{ "dec", 8, 1, 0, OP_TARGET_MODES } ,
+	{ "jmp", 9, 1, 0, OP_TARGET_MODES } ,
+	{ "bne", 10, 1, 0, OP_TARGET_MODES } ,
+	{ "red", 11, 1, 0, OP_TARGET_MODES } ,
+	{ "prn", 12, 1, 0, OP_ALL_MODES } ,
+	{ "jsr", 13, 1, 0, OP_TARGET_MODES } ,
+	{ "rts", 14, 0, 0, 0 } ,
+	{ "stop", 15, 0, 0, 0 } ,
 	{ NULL }
 }; 
 
-labelInfo *insertLabelIfValid(labelInfo label, lineInfo *line) /* Documentation in "assembler.h". */
+/* The command word, and a word for every operand, except for two registers that share a single word. */
+const unsigned char g_instructionWords[OP_MODES][OP_MODES] =
+{	/* none, OP_NUMERIC, OP_LABEL, -, OP_INDIRECT_REG, -, -, -, OP_REGULAR_REG */
+	{ 1, 2, 2, 0, 2, 0, 0, 0, 2 }, /* No source operand. */
+	{ 2, 3, 3, 0, 3, 0, 0, 0, 3 }, /* OP_NUMERIC */
+	{ 2, 3, 3, 0, 3, 0, 0, 0, 3 }, /* OP_LABEL */
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 2, 3, 3, 0, 2, 0, 0, 0, 2 }, /* OP_INDIRECT_REG */
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 2, 3, 3, 0, 2, 0, 0, 0, 2 }  /* OP_REGULAR_REG */
+};
+
+/* Perfect hash of the command names: (3 * name[0] + 18 * name[1] + name[2]) % OP_HASH_SIZE -> index in g_opArr, or -1.
+ * The factors were searched once for the fixed names, so every lookup is one hash and one final compare. */
+const signed char g_opHash[OP_HASH_SIZE] =
+{
+	-1, -1, 12, 1, -1, -1, 13, 10, -1, 8, -1, 0, 6, -1, -1, 2,
+	15, 14, -1, 5, 11, 3, -1, -1, 9, -1, 7, -1, -1, -1, -1, 4
+};
+
+labelInfo *insertLabelIfValid(assemblerContext *context, labelInfo label, lineInfo *line) /* Documentation in "assembler.h". */
 {
 	if (!isLegalLabel(line->lineStr, line->lineNum, TRUE)) /* Check if the label is legal. */
 	{
@@ -50,70 +77,41 @@ labelInfo *insertLabelIfValid(labelInfo label, lineInfo *line) /* Documentation
 		return NULL;
 	}
 	/* Checks if the label already exists. */
-	if (isExistingLabel(line->lineStr))
+	if (isExistingLabel(context, line->lineStr))
 	{
 		printError(line->lineNum, "ERROR: Label already exists.");
 		line->isError = TRUE;
 		return NULL;
 	}
-	strcpy(label.name, line->lineStr); /* Add the name to the label. */
-	if (g_labelCount < LABELS_MAX) /* Add the label to g_labelsArr and to the lineInfo. */
-	{
-		g_labelsArr[g_labelCount] = label;
-		return &g_labelsArr[g_labelCount++];
-	}
-	
-	printError(line->lineNum, "ERROR: Too many labels - max is %d.", LABELS_MAX, TRUE); /* Too many labels. */
-	line->isError = TRUE;
-	return NULL;
-}
-
-boolean insertValueIntoDataArray(int num, int *IC, int *DC, int lineNum) /* Documentation in "assembler.h". */
-{
-	if (*DC + *IC < RAM_LIMIT) /* Checks if there is enough space in g_arr for the data. */
-	{
-		g_arr[(*DC)++] = num;
-	}
-	else
-	{
-		return FALSE;
-	}
-	return TRUE;
+	label.nameId = internName(&context->names, line->lineStr); /* Add the name to the label. */
+	return addLabel(&context->labels, &label); /* Add the label to the labels of the context and to the lineInfo. */
 }
 
-char *findLabel(lineInfo *line, int IC) /* Documentation in "assembler.h". */
+void findLabel(assemblerContext *context, lineInfo *line, lineTokens *tokens, int IC) /* Documentation in "assembler.h". */
 {
-	char *labelEnd = strchr(line->lineStr, ':');
+	lineToken *token = peekToken(tokens);
 	labelInfo label = { 0 };
 	label.address = INITIAL_ADDRESS + IC;
 
-	if (!labelEnd) /* Find the label (or return NULL if there isn't) */
+	if (!token || token->kind != TOK_LABEL_DEF) /* The lexer only makes a label of the first word, before a ':'. */
 	{
-		return NULL;
-	}
-	*labelEnd = '\0';
-
-	if (!isOneWord(line->lineStr)) /* Check if the ':' came after the first word */
-	{
-		*labelEnd = ':'; /* Fix the change in line->lineStr. */
-		return NULL;
+		return;
 	}
-
-	line->label = insertLabelIfValid(label, line); /* Check of the label is legal and add it to the labelList. */
-	return labelEnd + 1; /* +1 to make it point at the next char after the \0. */
+	line->lineStr = nextToken(tokens)->str;
+	line->label = insertLabelIfValid(context, label, line); /* Check of the label is legal and add it to the labelList. */
 }
 
-void removeLastLabel(int lineNum) /* Documentation in "assembler.h". */
+void removeLastLabel(assemblerContext *context, int lineNum) /* Documentation in "assembler.h". */
 {
-	g_labelCount--;
+	removeLabel(&context->labels, context->labels.labels[context->labels.count - 1]);
 	printf("WARNING: At line %d: The assembler ignored the label before the directive.\n", lineNum);
 }
 
-void parseDataDirc(lineInfo *line, int *IC, int *DC) /* Documentation in "assembler.h". */
+void parseDataDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens, int *IC, int *DC) /* Documentation in "assembler.h". */
 {
-	char *operandTok = line->lineStr, *endOfOp = line->lineStr;
-	int operandValue;
-	boolean foundComma;
+	lineToken *operand;
+	int operandValue, count = 0, capacity = RAM_LIMIT - *IC - *DC; /* The values are written straight to the data and DC is updated once. */
+	boolean foundComma = FALSE;
 
 	if (line->label) /* Make the label a data label (if there is one). */
 	{
@@ -121,37 +119,35 @@ void parseDataDirc(lineInfo *line, int *IC, int *DC) /* Documentation in "assemb
 		line->label->address = INITIAL_ADDRESS + *DC;
 	}
 
-	if (isWhiteSpaces(line->lineStr)) /* Checks if there are params. */
+	if (!peekToken(tokens)) /* Checks if there are params. */
 	{
 		printError(line->lineNum, "ERROR: No parameter.");
 		line->isError = TRUE;
 		return;
 	}
 
-	INFINITE_LOOP /* Find all the params and add them to g_arr */
+	while ((operand = nextToken(tokens)) != NULL) /* Find all the params and add them to the data */
 	{
-		if (isWhiteSpaces(line->lineStr)) /* Get next param or break if there is none. */
-		{
-			break;
-		}
-		operandTok = getFirstOperand(line->lineStr, &endOfOp, &foundComma);
+		foundComma = acceptComma(tokens);
 		
-		if (isLegalNum(operandTok, WORD_LENGTH - 3, line->lineNum, &operandValue)) /* Add the param to g_arr. */
+		if (!isLegalNum(operand->str, WORD_LENGTH - 3, line->lineNum, &operandValue))
 		{
-			if (!insertValueIntoDataArray(operandValue, IC, DC, line->lineNum))
-			{
-				line->isError = TRUE; /* Not enough memory. */
-				return;
-			}
+			line->isError = TRUE; /* Illegal number. */
+			break;
 		}
-		else
+		if (count >= capacity)
 		{
-			line->isError = TRUE; /* Illegal number. */
-			return;
+			line->isError = TRUE; /* Not enough memory. */
+			break;
 		}
-		line->lineStr = endOfOp; /* Change the line to start after the parameter. */
+		context->data[*DC + count++] = (machineWord)(operandValue & WORD_MASK); /* Add the param to the data as a word. */
 	}
+	*DC += count; /* The values before an error are kept, like the memory full check expects. */
 
+	if (line->isError)
+	{
+		return;
+	}
 	if (foundComma)
 	{
 		printError(line->lineNum, "ERROR: Commas found after the last parameter."); /* Comma after the last param. */
@@ -160,54 +156,57 @@ void parseDataDirc(lineInfo *line, int *IC, int *DC) /* Documentation in "assemb
 	}
 }
 
-void parseStringDirc(lineInfo *line, int *IC, int *DC) /* Documentation in "assembler.h". */
+void parseStringDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens, int *IC, int *DC) /* Documentation in "assembler.h". */
 {
-	char *str;
+	lineToken *operand = nextToken(tokens); /* The rest of the line is a single token. */
+	int i, count, capacity = RAM_LIMIT - *IC - *DC;
     if (line->label) /* Make the label a data label (if there is one). */
     {
         line->label->isData = TRUE;
         line->label->address = INITIAL_ADDRESS + *DC;
     }
-    trimStr(&line->lineStr);
 
-    if (isLegalStringParam(&line->lineStr, line->lineNum))
+    if (operand->kind == TOK_STRING)
     {
-		str = line->lineStr;
-        while (*str)
+        count = operand->value + 1; /* The chars between the quotes and the \0 after them. */
+        if (count > capacity)
         {
-            if (!insertValueIntoDataArray((int)*str, IC, DC, line->lineNum))
-            {
-                line->isError = TRUE; /* Not enough memory. */
-                return;
-            }
-            str++;
+            count = capacity;
+            line->isError = TRUE; /* Not enough memory. */
         }
-		/* Ensure the string is null-terminated in the data array */
-        if (!insertValueIntoDataArray(0, IC, DC, line->lineNum))
+        for (i = 0; i < count; i++) /* Copy the string to the data at once. */
         {
-            line->isError = TRUE; /* Not enough memory. */
-            return;
+            context->data[*DC + i] = (i < operand->value) ? (machineWord)(operand->str[i + 1] & WORD_MASK) : 0;
         }
+        *DC += count;
     }
     else
     {
+        if (operand->kind == TOK_EMPTY)
+        {
+            printError(line->lineNum, "ERROR: No parameter.");
+        }
+        else
+        {
+            printError(line->lineNum, "ERROR: The parameter for .string must be enclosed in quotes.");
+        }
         line->isError = TRUE; /* Illegal string. */
         return;
     }
 }
 
 
-void parseExternDirc(lineInfo *line) /* Documentation in "assembler.h". */
+void parseExternDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens) /* Documentation in "assembler.h". */
 {
 	labelInfo label = { 0 }, *labelPointer;
 
 	if (line->label) /* If there is a label in the line, remove the it from labelArr. */
 	{
-		removeLastLabel(line->lineNum);
+		removeLastLabel(context, line->lineNum);
 	}
 
-	trimStr(&line->lineStr);
-	labelPointer = insertLabelIfValid(label, line);
+	line->lineStr = nextToken(tokens)->str; /* The rest of the line is a single token. */
+	labelPointer = insertLabelIfValid(context, label, line);
 
 	if (!line->isError) /* Make the label an extern label. */
 	{
@@ -216,41 +215,47 @@ void parseExternDirc(lineInfo *line) /* Documentation in "assembler.h". */
 	}
 }
 
-void parseEntryDirc(lineInfo *line) /* Documentation in "assembler.h". */
+void parseEntryDirc(assemblerContext *context, lineInfo *line, lineTokens *tokens) /* Documentation in "assembler.h". */
 {
 	if (line->label) /* If there is a label in the line, remove the it from labelArr. */
 	{
-		removeLastLabel(line->lineNum);
+		removeLastLabel(context, line->lineNum);
 	}
 
-	trimStr(&line->lineStr); /* Add the label to the entry labels list. */
+	line->lineStr = nextToken(tokens)->str; /* The rest of the line is a single token. */
 
 	if (isLegalLabel(line->lineStr, line->lineNum, TRUE))
 	{
-		if (isExistingEntryLabel(line->lineStr))
+		line->op1.str = line->lineStr; /* The label is the operand of the directive. */
+		line->op1.type = OP_LABEL;
+		line->op1.label = bindLabel(&context->labels, internName(&context->names, line->lineStr));
+		if (!addEntryLabel(context, line->op1.label, line->lineNum))
 		{
 			printError(line->lineNum, "ERROR: Label already defined as an entry label.");
 			line->isError = TRUE;
 		}
-		if (g_entryLabelsCount < LABELS_MAX)
-		{
-			g_entryLinesArr[g_entryLabelsCount++] = line;
-		}
 	}
 }
 
-void parseDirective(lineInfo *line, int *IC, int *DC) /* Documentation in "assembler.h". */
+int getDircId(char *dircName) /* Documentation in "assembler.h". */
 {
-	int i = 0;
-	while (g_dircArr[i].name)
+	int i;
+
+	if (!dircName[0] || !dircName[1]) /* Every directive name is longer. */
 	{
-		if (!strcmp(line->commandStr, g_dircArr[i].name))
-		{	
-			g_dircArr[i].parseFunc(line, IC, DC); /* Call the parse function for this type of directive. */
-			return;
-		}
-		i++;
-	}	
+		return -1;
+	}
+	i = g_dircHash[((unsigned char)dircName[1] + (unsigned char)dircName[2]) & (DIRC_HASH_SIZE - 1)];
+	return (i != -1 && strcmp(dircName, g_dircArr[i].name) == 0) ? i : -1;
+}
+
+void parseDirective(assemblerContext *context, lineInfo *line, int dircId, lineTokens *tokens, int *IC, int *DC) /* Documentation in "assembler.h". */
+{
+	if (dircId != -1)
+	{	
+		g_dircArr[dircId].parseFunc(context, line, tokens, IC, DC); /* Call the parse function for this type of directive. */
+		return;
+	}
 	
 	printError(line->lineNum, "ERROR: No such directive as \"%s\".", line->commandStr); /* line->commandStr isn't a real directive. */
 	line->isError = TRUE;
@@ -259,14 +264,14 @@ void parseDirective(lineInfo *line, int *IC, int *DC) /* Documentation in "assem
 boolean areLegalOpTypes(const command *cmd, operandInfo op1, operandInfo op2, int lineNum) /* Documentation in "assembler.h". */
 {
 	/* Checks First Operand. */
-	if (cmd->opcode == 4 && op1.type != OP_LABEL) /* "lea" command (opcode is 4) can only get a label as the 1st op. */
+	if (op1.type != OP_INVALID && !(cmd->srcModes & op1.type)) /* Only "lea" limits its source, to a label. */
 	{
 		printError(lineNum, "ERROR: Source operand for \"%s\" command must be a label.", cmd->name);
 		return FALSE;
 	}
 
 	/* Checks Second Operand.*/
-	if (op2.type == OP_NUMERIC && cmd->opcode != 1 && cmd->opcode != 12) /* 2nd operand can be a number only if the command is "cmp" (opcode is 1) or "prn" (opcode is 12). */
+	if (op2.type != OP_INVALID && !(cmd->destModes & op2.type)) /* Only "cmp" and "prn" can get a number as the destination. */
 	{
 		printError(lineNum, "ERROR: Destination operand for \"%s\" command can't be a number.", cmd->name);
 		return FALSE;
@@ -274,18 +279,19 @@ boolean areLegalOpTypes(const command *cmd, operandInfo op1, operandInfo op2, in
 	return TRUE;
 }
 
-void parseOpInfo(operandInfo *operand, int lineNum) /* Documentation in "assembler.h". */
+void parseOpInfo(assemblerContext *context, operandInfo *operand, lineToken *token, int lineNum) /* Documentation in "assembler.h". */
 {
 	int value = 0;
 
-	if (isWhiteSpaces(operand->str))
+	operand->str = token->str;
+	if (token->kind == TOK_EMPTY)
 	{
 		printError(lineNum, "ERROR: Empty parameter.");
 		operand->type = OP_INVALID;
 		return;
 	}
 
-	if (*operand->str == '#') /* Checks if the type is a OP_NUMERIC. */
+	if (token->kind == TOK_IMMEDIATE) /* Checks if the type is a OP_NUMERIC. */
 	{
 		operand->str++; /* Remove the '#'. */
 		if (isspace(*operand->str)) /* Checks if the number is legal. */
@@ -299,17 +305,20 @@ void parseOpInfo(operandInfo *operand, int lineNum) /* Documentation in "assembl
 		}
 	 }
 	
-	else if (isIndirectRegister(operand->str, &value)) /* Checks if the type is OP_INDIRECT_REG. */
+	else if (token->kind == TOK_INDIRECT_REG) /* Checks if the type is OP_INDIRECT_REG. */
 	{
 		operand->type = OP_INDIRECT_REG;
+		value = token->value;
 	}
-	else if (isRegister(operand->str, &value)) /* Checks if the type is OP_REGULAR_REG. */
+	else if (token->kind == TOK_REGISTER) /* Checks if the type is OP_REGULAR_REG. */
 	{
 		operand->type = OP_REGULAR_REG;
+		value = token->value;
 	}
-	else if (isLegalLabel(operand->str, lineNum, FALSE)) /* Checks if the type is OP_LABEL. */
+	else if (token->kind == TOK_IDENTIFIER && isLegalLabel(operand->str, lineNum, FALSE)) /* Checks if the type is OP_LABEL (not too long and not a command). */
 	{
 		operand->type = OP_LABEL;
+		operand->label = bindLabel(&context->labels, internName(&context->names, operand->str)); /* The passes use the label without looking it up again. */
 	}
 	else /* The type is OP_INVALID. */
 	{
@@ -321,9 +330,9 @@ void parseOpInfo(operandInfo *operand, int lineNum) /* Documentation in "assembl
 	operand->value = value;
 }
 	
-void parseCmdOperands(lineInfo *line, int *IC, int *DC) /* Documentation in "assembler.h". */
+void parseCmdOperands(assemblerContext *context, lineInfo *line, lineTokens *tokens, int *IC, int *DC) /* Documentation in "assembler.h". */
 {
-	char *startOfNextPart = line->lineStr;
+	lineToken *operand;
 	boolean foundComma = FALSE;
 	int numOfOpsFound = 0;
 
@@ -331,46 +340,38 @@ void parseCmdOperands(lineInfo *line, int *IC, int *DC) /* Documentation in "ass
 	line->op1.type = OP_INVALID;
 	line->op2.type = OP_INVALID;
 	
-	INFINITE_LOOP /* Get the parameters. */
+	while (peekToken(tokens) && numOfOpsFound <= 2) /* Get the parameters, if there are more than 2 operands it's illegal. */
 	{
-		/* If both of the operands are registers, or indirect registers they will only take 1 memory word (instead of 2). */
-		if (!(line->op1.type == OP_REGULAR_REG && line->op2.type == OP_REGULAR_REG) && !(line->op1.type == OP_REGULAR_REG && line->op2.type == OP_INDIRECT_REG) && !(line->op1.type == OP_INDIRECT_REG && line->op2.type == OP_REGULAR_REG) && !(line->op1.type == OP_INDIRECT_REG && line->op2.type == OP_INDIRECT_REG))
-		{	
-			if (*IC + *DC < RAM_LIMIT) /* Checks if there is enough memory. */
-			{
-				++*IC; /* Count the last command word or operand. */
-			}
-			else
-			{
-				line->isError = TRUE;
-				return;
-			}
-		}
-		
-		if (isWhiteSpaces(line->lineStr) || numOfOpsFound > 2) /* Checks if there are still more operands to read. */
-		{
-			break; /* If there are more than 2 operands it's illegal. */
-		}
-
 		if (numOfOpsFound == 1) /* If there are 2 ops, make the destination become the source op. */
 		{
 			line->op1 = line->op2;
 			line->op2.type = OP_INVALID; /* Reset op2. */
 		}
 		
-		line->op2.str = getFirstOperand(line->lineStr, &startOfNextPart, &foundComma); /* Parse the opernad. */
-		parseOpInfo(&line->op2, line->lineNum);
+		operand = nextToken(tokens); /* Parse the opernad. */
+		foundComma = acceptComma(tokens);
+		parseOpInfo(context, &line->op2, operand, line->lineNum);
 
 		if (line->op2.type == OP_INVALID)
 		{
 			line->isError = TRUE;
-			return;
+			break;
 		}
 
 		numOfOpsFound++;
-		line->lineStr = startOfNextPart;
 	} /* While loop end. */
 
+	if (!reserveInstructionWords(line, IC, DC)) /* The words of the operands that were read are counted, even for an illegal line. */
+	{
+		line->isError = TRUE; /* Not enough memory. */
+		return;
+	}
+
+	if (line->isError)
+	{
+		return;
+	}
+
 	if (numOfOpsFound != line->cmd->numOfParams) /* Checks if there are enough operands. */
 	{
 		
@@ -400,10 +401,21 @@ void parseCmdOperands(lineInfo *line, int *IC, int *DC) /* Documentation in "ass
 	}
 }
 
-void parseCommand(lineInfo *line, int *IC, int *DC) /* Documentation in "assembler.h". */
+boolean reserveInstructionWords(lineInfo *line, int *IC, int *DC) /* Documentation in "assembler.h". */
 {
-	int cmdId = getCmdId(line->commandStr);
+	int words = g_instructionWords[getOpMode(line->op1.type)][getOpMode(line->op2.type)];
+
+	if (*IC + *DC + words > RAM_LIMIT)
+	{
+		*IC = RAM_LIMIT - *DC; /* The words that fit are counted, so the memory full check stops the file. */
+		return FALSE;
+	}
+	*IC += words;
+	return TRUE;
+}
 
+void parseCommand(assemblerContext *context, lineInfo *line, int cmdId, lineTokens *tokens, int *IC, int *DC) /* Documentation in "assembler.h". */
+{
 	if (cmdId == -1)
 	{
 		line->cmd = NULL;
@@ -420,120 +432,70 @@ void parseCommand(lineInfo *line, int *IC, int *DC) /* Documentation in "assembl
 	}
 
 	line->cmd = &g_opArr[cmdId];
-	parseCmdOperands(line, IC, DC);
-}
-
-char *allocString(const char *str) 
-{
-	char *newString = (char *)malloc(strlen(str) + 1);
-	if (newString) 
-	{
-		strcpy(newString, str); 
-	}
-
-	return newString;
+	parseCmdOperands(context, line, tokens, IC, DC);
 }
 
-void parseLine(lineInfo *line, char *lineStr, int lineNum, int *IC, int *DC) /* Documentation in "assembler.h". */
+void parseLine(assemblerContext *context, lineInfo *line, char *lineStr, int lineNum, int *IC, int *DC) /* Documentation in "assembler.h". */
 {
-	char *startOfNextPart = lineStr;
+	lineTokens tokens;
+	lineToken *command;
+	LineKind kind;
 
 	line->lineNum = lineNum;
 	line->address = INITIAL_ADDRESS + *IC;
-	line->originalString = allocString(lineStr);
-	line->lineStr = line->originalString;
+	line->lineStr = lineStr;
 	line->isError = FALSE;
 	line->label = NULL;
 	line->commandStr = NULL;
 	line->cmd = NULL;
 
-	if (!line->originalString)
-	{
-		printf("ERROR: Malloc failed, not enough memory.");
-		return;
-	}
-	if (isCommentOrEmpty(line)) /* Check if the line is a comment. */
+	kind = tokenizeLine(lineStr, &tokens); /* Split the line into tokens, the parsers below only read the tokens. */
+	if (kind == LINE_EMPTY) /* Check if the line is a comment. */
 	{	
 		return;
 	}
-	startOfNextPart = findLabel(line, *IC); /* Find a label and add it to the label list. */
-
-	if (line->isError)
+	if (kind == LINE_BAD_COMMENT)
 	{
+		printError(line->lineNum, "ERROR: Comments must start with ';' at the start of the line.");
+		line->isError = TRUE;
 		return;
 	}
-	if (startOfNextPart) /* Update the line if startOfNextPart isn't NULL. */
-	{
-		line->lineStr = startOfNextPart;
-	}	
-	line->commandStr = getFirstTok(line->lineStr, &startOfNextPart); /* Find the command token. */
-	line->lineStr = startOfNextPart;
-	
-	if (isDirective(line->commandStr)) /* Parse the command / directive. */
-	{
-		line->commandStr++; /* Remove the '.' from the command. */
-		parseDirective(line, IC, DC);
-	}
-	else
-	{
-		parseCommand(line, IC, DC);
-	}
+	findLabel(context, line, &tokens, *IC); /* Find a label and add it to the label list. */
+
 	if (line->isError)
 	{
 		return;
 	}
-}
-
-boolean readLine(FILE *file, char *line_data, size_t maxLength) /* Documentation in "assembler.h". */
-{
-	char *endOfLine;
-
-	if (!fgets(line_data, maxLength, file))
-	{
-		return FALSE;
-	}
-	endOfLine = strchr(line_data, '\n'); /* Check if the line is too long (no '\n' was present). */
-
-	if (endOfLine)
+	command = nextToken(&tokens); /* The lexer always makes a command token, it is empty if the line is only a label. */
+	line->commandStr = command->str;
+	
+	if (command->kind == TOK_DIRECTIVE) /* Parse the command / directive. */
 	{
-		*endOfLine = '\0';
+		parseDirective(context, line, command->value, &tokens, IC, DC);
 	}
 	else
 	{
-		char c;
-		boolean ret = (feof(file)) ? TRUE : FALSE; /* Return FALSE, unless it's the end of the file. */
-
-		do /* Keep reading chars until you reach the end of the line ('\n') or EOF. */
-		{
-			c = fgetc(file);
-		} while (c != '\n' && c != EOF);
-
-		return ret;
+		parseCommand(context, line, command->value, &tokens, IC, DC);
 	}
-
-	return TRUE;
 }
 
-int firstPass(FILE *file, lineInfo *linesArr, int *linesCount, int *IC, int *DC) /* Documentation in "assembler.h". */
+int firstPass(assemblerContext *context, char *source, instructionTable *instructions, fixupList *fixups, int *IC, int *DC) /* Documentation in "assembler.h". */
 {
-	char lineStr[LINE_MAX_LENGTH + 2]; /* +2 for the \n and \0 at the end */
-	int errorsFound = 0;
-	*linesCount = 0;
+	lineGenerator generator;
+	GeneratorStatus status;
+	lineInfo line, emptyLine = { 0 };
+	char *lineStr;
+	int errorsFound = 0, lineNum;
 
-	
-	while (!feof(file)) /* Read lines and parse them. */
+	initLineGenerator(&generator, source);
+	while ((status = nextSourceLine(&generator, &lineStr, &lineNum)) != GEN_END) /* Read lines and parse them. */
 	{
-		if (readLine(file, lineStr, LINE_MAX_LENGTH + 2)) 
+		if (status == GEN_LINE) 
 		{
-			if (*linesCount >= LINES_MAX_LENGTH) /* Checks if the file is too long. */
-			{
-				printf("ERROR: The file is too long. Max number of lines in a file is %d.\n", LINES_MAX_LENGTH);
-				return ++errorsFound;
-			}
-
-			parseLine(&linesArr[*linesCount], lineStr, *linesCount + 1, IC, DC); /* Parse a line. */
+			line = emptyLine; /* Only the instruction table and the labels outlive the line. */
+			parseLine(context, &line, lineStr, lineNum, IC, DC); /* Parse a line. */
 
-			if (linesArr[*linesCount].isError) /* Update errorsFound. */
+			if (line.isError) /* Update errorsFound. */
 			{
 				errorsFound++;
 			}
@@ -541,18 +503,29 @@ int firstPass(FILE *file, lineInfo *linesArr, int *linesCount, int *IC, int *DC)
 			if (*IC + *DC >= RAM_LIMIT) /* Check if the number of memory words needed is small enough. */
 			{
 				
-				printError(*linesCount + 1, "ERROR: The max memory words is %d, too much data and code.", RAM_LIMIT); /* dataArr is full. Stop reading the file. */
+				printError(lineNum, "ERROR: The max memory words is %d, too much data and code.", RAM_LIMIT); /* dataArr is full. Stop reading the file. */
 				printf("Memory is full, file reading terminated.\n");
 				return ++errorsFound;
 			}
-			++*linesCount;
+
+			if (!line.isError && line.cmd && fixups) /* Single pass mode, the words are written now. */
+			{
+				emitInstruction(fixups, &line);
+			}
+			else if (!line.isError && line.cmd) /* The second pass only reads the valid instructions. */
+			{
+				addInstruction(instructions, &line);
+			}
 		}
-		else if (!feof(file))
+		else if (status == GEN_LONG_LINE)
 		{
 			
-			printError(*linesCount + 1, "ERROR: The max line length is %d, line is too long.", LINE_MAX_LENGTH); /* Line is too long. */
+			printError(lineNum, "ERROR: The max line length is %d, line is too long.", LINE_MAX_LENGTH); /* Line is too long. */
+			errorsFound++;
+		}
+		else /* A wrong .rept or .endr, the error was already printed. */
+		{
 			errorsFound++;
-			 ++*linesCount;
 		}
 	}
 
@@ -5,184 +5,417 @@
 #include "helpers.h"
 #include "preprocessor.h"
 
-char *stringDuplicate(const char *original)
+char *arenaStringDuplicate(memoryArena *memory, const char *original)
 {
     size_t length = strlen(original) + 1;
-    char *duplicate = allocateMemory(length); /* Allocate memory for the new string. */
-    if (duplicate)
-    {
-        strcpy(duplicate, original); /* Copy the original string to the newly allocated memory. */
-    }
+    char *duplicate = arenaAllocate(memory, length); /* Allocate memory for the new string. */
+    memcpy(duplicate, original, length); /* Copy the original string to the newly allocated memory. */
     return duplicate;
 }
 
-void addToTheList(MacroNode **head, char *name, char *content, int line)
+unsigned long hashString(const char *str, size_t length)
 {
-    MacroNode *new_node = (MacroNode *)malloc(sizeof(MacroNode)); /* Allocate memory for a new MacroNode. */
-    if (!new_node)
+    unsigned long hash = 2166136261UL; /* FNV-1a offset basis. */
+    size_t i;
+
+    for (i = 0; i < length; i++)
     {
-        fprintf(stdout, "ERROR: Failed to allocate memory for new MacroNode.\n");
-        exit(EXIT_FAILURE);
+        hash ^= (unsigned char)str[i];
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL; /* FNV-1a prime, kept to 32 bits. */
     }
-    new_node->name = stringDuplicate(name); /* Duplicate the name string. */
-    new_node->content = stringDuplicate(content); /* Duplicate the content string. */
-    new_node->line = line;
-    new_node->next = *head;
-    *head = new_node; /* Insert the new MacroNode at the beginning of the list. */
+    return hash;
 }
 
+void initMacroTable(macroTable *table, memoryArena *memory)
+{
+    table->size = MACRO_TABLE_INITIAL_SIZE;
+    table->count = 0;
+    table->memory = memory;
+    table->buckets = (MacroNode **)arenaAllocateZeroed(memory, table->size * sizeof(MacroNode *));
+}
 
-
-void freeList(MacroNode *head)
+void growMacroTable(macroTable *table)
 {
-    MacroNode *temp;
-    while (head)
+    int new_size = table->size * 2, i;
+    MacroNode **new_buckets = (MacroNode **)arenaAllocateZeroed(table->memory, new_size * sizeof(MacroNode *));
+    MacroNode *node, *next;
+
+    for (i = 0; i < table->size; i++) /* Move every macro to its bucket in the new array. */
     {
-        temp = head;
-        head = head->next;
-        free(temp->name); /* Free the memory allocated for the name. */
-        free(temp->content); /* Free the memory allocated for the content. */
-        free(temp); /* Free the MacroNode itself. */
+        for (node = table->buckets[i]; node; node = next)
+        {
+            int bucket = (int)(hashString(node->name, strlen(node->name)) & (new_size - 1));
+            next = node->next;
+            node->next = new_buckets[bucket];
+            new_buckets[bucket] = node;
+        }
     }
+
+    table->buckets = new_buckets; /* The old buckets are released with the arena. */
+    table->size = new_size;
 }
 
-labelInfo *getLabel(char *labelName)
+MacroNode *findMacro(macroTable *table, const char *name, size_t length)
 {
-    int i = 0;
+    MacroNode *node = table->buckets[hashString(name, length) & (table->size - 1)];
 
-    if (labelName)
+    while (node)
     {
-        for (i = 0; i < g_labelCount; i++)
+        if (strncmp(node->name, name, length) == 0 && node->name[length] == '\0')
         {
-            if (strcmp(labelName, g_labelsArr[i].name) == 0)
-            {
-                return &g_labelsArr[i]; /* Return a pointer to the label if found. */
-            }
+            return node; /* Return the macro if found. */
         }
+        node = node->next;
     }
-    return NULL; /* Return NULL if the label is not found. */
+    return NULL; /* Return NULL if there is no such macro. */
 }
 
-int getCmdId(char *cmdName)
+MacroNode *addMacro(macroTable *table, char *name, char *content, int line)
 {
-    int i = 0;
+    MacroNode *new_node = findMacro(table, name, strlen(name));
 
-    while (g_opArr[i].name)
+    if (new_node) /* A macro that is defined again takes the new content. */
     {
-        if (strcmp(cmdName, g_opArr[i].name) == 0)
-        {
-            return i; /* Return the command ID if found. */
-        }
+        new_node->content = arenaStringDuplicate(table->memory, content);
+        new_node->line = line;
+        return new_node;
+    }
+
+    new_node = (MacroNode *)arenaAllocate(table->memory, sizeof(MacroNode)); /* Allocate memory for a new MacroNode. */
+    new_node->name = arenaStringDuplicate(table->memory, name); /* Duplicate the name string. */
+    new_node->content = arenaStringDuplicate(table->memory, content); /* Duplicate the content string. */
+    new_node->line = line;
+    new_node->params = "";
+    new_node->state = MACRO_EXPANDED;
+    new_node->numParams = new_node->numSegments = 0;
+    new_node->segments = NULL;
+    new_node->calling = NULL;
+    insertMacroNode(table, new_node);
+    return new_node;
+}
+
+void insertMacroNode(macroTable *table, MacroNode *node)
+{
+    int bucket;
 
-        i++;
+    if (table->count >= table->size) /* Keep about one macro per bucket. */
+    {
+        growMacroTable(table);
     }
-    return -1; /* Return -1 if the command is not found. */
+
+    bucket = (int)(hashString(node->name, strlen(node->name)) & (table->size - 1));
+    node->next = table->buckets[bucket];
+    table->buckets[bucket] = node; /* Insert the new MacroNode at the beginning of its bucket. */
+    table->count++;
 }
 
-void unexpectedCrash(int args_count, ...)
+void initInternTable(internTable *table, memoryArena *memory)
 {
-    char *str;
+    table->memory = memory;
+    table->size = INTERN_TABLE_INITIAL_SIZE;
+    table->slots = (int *)arenaAllocateZeroed(memory, table->size * sizeof(int));
+    table->capacity = INTERN_TABLE_INITIAL_SIZE / 2;
+    table->names = (char **)arenaAllocate(memory, table->capacity * sizeof(char *));
+    table->count = 0;
+}
+
+int findNameSlot(internTable *table, char *name)
+{
+    int mask = table->size - 1;
+    int slot = (int)(hashString(name, strlen(name)) & mask);
+
+    while (table->slots[slot] && strcmp(table->names[table->slots[slot] - 1], name) != 0) /* Linear probing. */
+    {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void growInternTable(internTable *table)
+{
+    char **old_names = table->names;
     int i;
-    FILE *source_pointer;
-    va_list args;
-    va_start(args, args_count); /* Initialize the va_list with the argument count. */
 
-    for (i = 0; i < args_count; i++)
+    table->size *= 2;
+    table->slots = (int *)arenaAllocateZeroed(table->memory, table->size * sizeof(int));
+    for (i = 0; i < table->count; i++) /* Move every ID to the slot of its name in the new array. */
     {
-        if (strcmp(va_arg(args, char*), "%s") == 0)
-        {
-            i++;
-            str = va_arg(args, char*); /* Get the next argument as a string. */
-            remove(str); /* Remove the file associated with the string. */
-            free(str); /* Free the memory allocated for the string. */
-        }
-        else
+        table->slots[findNameSlot(table, old_names[i])] = i + 1;
+    }
+
+    table->capacity = table->size / 2;
+    table->names = (char **)arenaAllocate(table->memory, table->capacity * sizeof(char *));
+    memcpy(table->names, old_names, table->count * sizeof(char *)); /* The old arrays are released with the arena. */
+}
+
+int findNameId(internTable *table, char *name)
+{
+    return table->slots[findNameSlot(table, name)] - 1; /* -1 for an empty slot. */
+}
+
+int internName(internTable *table, char *name)
+{
+    int slot;
+
+    if (table->count >= table->capacity) /* Keep at least half of the slots empty. */
+    {
+        growInternTable(table);
+    }
+
+    slot = findNameSlot(table, name);
+    if (!table->slots[slot]) /* A new name. */
+    {
+        table->names[table->count] = arenaStringDuplicate(table->memory, name);
+        table->slots[slot] = ++table->count;
+    }
+    return table->slots[slot] - 1;
+}
+
+void initLabelTable(labelTable *table, memoryArena *memory)
+{
+    table->memory = memory;
+    table->idCapacity = LABEL_TABLE_INITIAL_SIZE;
+    table->byId = (labelInfo **)arenaAllocateZeroed(memory, table->idCapacity * sizeof(labelInfo *));
+    table->capacity = LABEL_TABLE_INITIAL_SIZE;
+    table->labels = (labelInfo **)arenaAllocate(memory, table->capacity * sizeof(labelInfo *));
+    table->count = 0;
+}
+
+void reserveLabelId(labelTable *table, int nameId)
+{
+    labelInfo **old;
+    int old_capacity;
+
+    if (nameId >= table->idCapacity) /* Make room for the ID, the old array is released with the arena. */
+    {
+        old = table->byId;
+        old_capacity = table->idCapacity;
+        while (nameId >= table->idCapacity)
         {
-            source_pointer = va_arg(args, FILE*); /* Get the next argument as a FILE pointer. */
-            fclose(source_pointer); /* Close the file. */
+            table->idCapacity *= 2;
         }
+        table->byId = (labelInfo **)arenaAllocateZeroed(table->memory, table->idCapacity * sizeof(labelInfo *));
+        memcpy(table->byId, old, old_capacity * sizeof(labelInfo *));
     }
-    va_end(args); /* Clean up the va_list. */
 }
 
-void trimLeftStr(char **ptStr)
+labelInfo *bindLabel(labelTable *table, int nameId)
 {
-    if (!ptStr)
+    labelInfo *label;
+
+    reserveLabelId(table, nameId);
+    if (!table->byId[nameId]) /* A forward reference, the definition fills the same label. */
     {
-        return; /* Return if the pointer is NULL. */
+        label = (labelInfo *)arenaAllocateZeroed(table->memory, sizeof(labelInfo));
+        label->nameId = nameId;
+        table->byId[nameId] = label;
     }
+    return table->byId[nameId];
+}
 
-    while (isspace(**ptStr))
+labelInfo *addLabel(labelTable *table, labelInfo *label)
+{
+    labelInfo *new_label, **old;
+
+    if (table->count >= table->capacity)
     {
-        ++*ptStr; /* Increment the pointer to skip leading whitespace. */
+        old = table->labels;
+        table->capacity *= 2;
+        table->labels = (labelInfo **)arenaAllocate(table->memory, table->capacity * sizeof(labelInfo *));
+        memcpy(table->labels, old, table->count * sizeof(labelInfo *));
     }
+
+    new_label = bindLabel(table, label->nameId); /* Operands that were bound before the definition see it too. */
+    new_label->address = label->address;
+    new_label->isExtern = label->isExtern;
+    new_label->isData = label->isData;
+    new_label->isDefined = TRUE; /* An .entry before the definition is kept. */
+    table->labels[table->count++] = new_label;
+    return new_label;
 }
 
-void trimStr(char **ptStr)
+void removeLabel(labelTable *table, labelInfo *label)
 {
-    char *endofstring;
+    int i;
 
-    if (!ptStr || **ptStr == '\0')
+    label->isDefined = FALSE; /* Operands may be bound to it, so it stays as a forward reference. */
+    for (i = table->count - 1; i >= 0 && table->labels[i] != label; i--)
+    {
+        ;
+    }
+    if (i >= 0) /* Keep the order of the other labels. */
     {
-        return; /* Return if the pointer is NULL or points to an empty string. */
+        memmove(&table->labels[i], &table->labels[i + 1], (table->count - i - 1) * sizeof(labelInfo *));
+        table->count--;
     }
+}
 
-    trimLeftStr(ptStr); /* Remove leading whitespace. */
+labelInfo *getLabelById(assemblerContext *context, int nameId)
+{
+    labelInfo *label = (nameId >= 0 && nameId < context->labels.idCapacity) ? context->labels.byId[nameId] : NULL;
 
-    endofstring = *ptStr + strlen(*ptStr) - 1; /* Find the end of the string. */
+    return (label && label->isDefined) ? label : NULL;
+}
 
-    while (isspace(*endofstring) && endofstring != *ptStr)
+labelInfo *getLabel(assemblerContext *context, char *labelName)
+{
+    if (labelName)
     {
-        *endofstring-- = '\0'; /* Remove trailing whitespace. */
+        return getLabelById(context, findNameId(&context->names, labelName)); /* A name without an ID isn't a label. */
     }
+    return NULL; /* Return NULL if the label is not found. */
 }
 
-char *getFirstTok(char *str, char **endOfTok)
+void initInstructionTable(instructionTable *table, memoryArena *memory)
 {
-    char *tokStart = str;
-    char *tokEnd = NULL;
+    table->memory = memory;
+    table->count = 0;
+    table->capacity = 0;
+    growInstructionTable(table);
+}
 
-    trimLeftStr(&tokStart); /* Remove leading whitespace. */
+void growInstructionTable(instructionTable *table)
+{
+    instructionTable old = *table;
+
+    table->capacity = old.capacity ? old.capacity * 2 : INSTRUCTION_TABLE_INITIAL_SIZE; /* The old arrays are released with the arena. */
+    table->opcodes = (unsigned char *)arenaAllocate(table->memory, table->capacity);
+    table->srcModes = (unsigned char *)arenaAllocate(table->memory, table->capacity);
+    table->destModes = (unsigned char *)arenaAllocate(table->memory, table->capacity);
+    table->srcValues = (int *)arenaAllocate(table->memory, table->capacity * sizeof(int));
+    table->destValues = (int *)arenaAllocate(table->memory, table->capacity * sizeof(int));
+    table->srcLabels = (labelInfo **)arenaAllocate(table->memory, table->capacity * sizeof(labelInfo *));
+    table->destLabels = (labelInfo **)arenaAllocate(table->memory, table->capacity * sizeof(labelInfo *));
+    table->lineNums = (int *)arenaAllocate(table->memory, table->capacity * sizeof(int));
+    table->addresses = (int *)arenaAllocate(table->memory, table->capacity * sizeof(int));
+
+    if (old.count)
+    {
+        memcpy(table->opcodes, old.opcodes, old.count);
+        memcpy(table->srcModes, old.srcModes, old.count);
+        memcpy(table->destModes, old.destModes, old.count);
+        memcpy(table->srcValues, old.srcValues, old.count * sizeof(int));
+        memcpy(table->destValues, old.destValues, old.count * sizeof(int));
+        memcpy(table->srcLabels, old.srcLabels, old.count * sizeof(labelInfo *));
+        memcpy(table->destLabels, old.destLabels, old.count * sizeof(labelInfo *));
+        memcpy(table->lineNums, old.lineNums, old.count * sizeof(int));
+        memcpy(table->addresses, old.addresses, old.count * sizeof(int));
+    }
+}
 
-    tokEnd = tokStart;
-    while (*tokEnd != '\0' && !isspace(*tokEnd))
+void addInstruction(instructionTable *table, lineInfo *line)
+{
+    int i = table->count;
+
+    if (i >= table->capacity)
     {
-        tokEnd++; /* Find the end of the first token. */
+        growInstructionTable(table);
     }
 
-    if (*tokEnd != '\0')
+    table->opcodes[i] = line->cmd->opcode;
+    table->srcModes[i] = getOpMode(line->op1.type);
+    table->destModes[i] = getOpMode(line->op2.type);
+    table->srcValues[i] = line->op1.value;
+    table->destValues[i] = line->op2.value;
+    table->srcLabels[i] = (line->op1.type == OP_LABEL) ? line->op1.label : NULL; /* Labels are resolved by the second pass. */
+    table->destLabels[i] = (line->op2.type == OP_LABEL) ? line->op2.label : NULL;
+    table->lineNums[i] = line->lineNum;
+    table->addresses[i] = line->address;
+    table->count++;
+}
+
+boolean addEntryLabel(assemblerContext *context, labelInfo *label, int lineNum)
+{
+    labelInfo **old = context->entryLabels;
+
+    if (label->entryLineNum) /* Every label is an entry once. */
+    {
+        return FALSE;
+    }
+    if (context->entryLabelsCount >= context->entryLabelsCapacity) /* The old array is released with the arena. */
     {
-        *tokEnd = '\0'; /* Null-terminate the token. */
-        tokEnd++;
+        context->entryLabelsCapacity = context->entryLabelsCapacity ? context->entryLabelsCapacity * 2 : ENTRY_LABELS_INITIAL_SIZE;
+        context->entryLabels = (labelInfo **)arenaAllocate(&context->memory, context->entryLabelsCapacity * sizeof(labelInfo *));
+        if (context->entryLabelsCount)
+        {
+            memcpy(context->entryLabels, old, context->entryLabelsCount * sizeof(labelInfo *));
+        }
     }
+    label->entryLineNum = lineNum;
+    context->entryLabels[context->entryLabelsCount++] = label;
+    return TRUE;
+}
 
-    if (endOfTok)
+void initFixupList(fixupList *list, machineWord *memoryArr, memoryArena *memory)
+{
+    list->memoryArr = memoryArr;
+    list->memory = memory;
+    list->count = 0;
+    list->capacity = FIXUP_LIST_INITIAL_SIZE;
+    list->fixups = (fixup *)arenaAllocate(memory, list->capacity * sizeof(fixup));
+}
+
+void addFixup(fixupList *list, int wordIndex, labelInfo *label, int lineNum)
+{
+    fixup *old = list->fixups;
+
+    if (list->count >= list->capacity) /* The old array is released with the arena. */
     {
-        *endOfTok = tokEnd; /* Update the endOfTok pointer. */
+        list->capacity *= 2;
+        list->fixups = (fixup *)arenaAllocate(list->memory, list->capacity * sizeof(fixup));
+        memcpy(list->fixups, old, list->count * sizeof(fixup));
     }
-    return tokStart; /* Return the start of the first token. */
+    list->fixups[list->count].wordIndex = wordIndex;
+    list->fixups[list->count].lineNum = lineNum;
+    list->fixups[list->count].label = label;
+    list->count++;
 }
 
-boolean isOneWord(char *str)
+int getOpMode(OperandType type)
 {
-    trimLeftStr(&str); /* Remove leading whitespace. */
-    while (!isspace(*str) && *str)
+    return (type != OP_INVALID) ? (int)type : 0; /* 0 is no operand. */
+}
+
+int getCmdId(char *cmdName)
+{
+    int i;
+
+    if (!cmdName[0] || !cmdName[1]) /* Every command name is longer. */
     {
-        str++; /* Skip the text in the middle. */
+        return -1;
     }
-    return isWhiteSpaces(str); /* Check if the remaining text is all whitespace. */
+
+    i = g_opHash[(3 * (unsigned char)cmdName[0] + 18 * (unsigned char)cmdName[1] + (unsigned char)cmdName[2]) & (OP_HASH_SIZE - 1)];
+    if (i != -1 && strcmp(cmdName, g_opArr[i].name) == 0)
+    {
+        return i; /* Return the command ID if found. */
+    }
+    return -1; /* Return -1 if the command is not found. */
 }
 
-boolean isWhiteSpaces(char *str)
+void unexpectedCrash(int args_count, ...)
 {
-    while (*str)
+    char *str;
+    int i;
+    FILE *source_pointer;
+    va_list args;
+    va_start(args, args_count); /* Initialize the va_list with the argument count. */
+
+    for (i = 0; i < args_count; i++)
     {
-        if (!isspace(*str++))
+        if (strcmp(va_arg(args, char*), "%s") == 0)
         {
-            return FALSE; /* Return false if a non-whitespace character is found. */
+            i++;
+            str = va_arg(args, char*); /* Get the next argument as a string. */
+            remove(str); /* Remove the file associated with the string, its name is released with the arena. */
+        }
+        else
+        {
+            source_pointer = va_arg(args, FILE*); /* Get the next argument as a FILE pointer. */
+            fclose(source_pointer); /* Close the file. */
         }
     }
-    return TRUE; /* Return true if only whitespace characters are found. */
+    va_end(args); /* Clean up the va_list. */
 }
 
 boolean isLegalLabel(char *labelStr, int lineNum, boolean printErrors)
@@ -267,9 +500,9 @@ boolean isLegalLabel(char *labelStr, int lineNum, boolean printErrors)
     return TRUE;
 }
 
-boolean isExistingLabel(char *label)
+boolean isExistingLabel(assemblerContext *context, char *label)
 {
-    if (getLabel(label))
+    if (getLabel(context, label))
     {
         printf("ERROR: Existing label was found: %s\n", label);
         return TRUE; /* Return true if the label exists. */
@@ -278,23 +511,6 @@ boolean isExistingLabel(char *label)
     return FALSE;
 }
 
-boolean isExistingEntryLabel(char *labelName)
-{
-    int i = 0;
-
-    if (labelName)
-    {
-        for (i = 0; i < g_entryLabelsCount; i++)
-        {
-            if (strcmp(labelName, g_entryLinesArr[i]->lineStr) == 0)
-            {
-                return TRUE; /* Return true if the label is an existing entry label. */
-            }
-        }
-    }
-    return FALSE;
-}
-
 boolean isRegister(char *str, int *value)
 {
     if (str[0] == 'r' && str[1] >= '0' && str[1] - '0' <= NUM_OF_REG && str[2] == '\0')
@@ -323,113 +539,78 @@ boolean isIndirectRegister(char *str, int *value)
     return FALSE;
 }
 
-boolean isCommentOrEmpty(lineInfo *line)
-{
-    char *startOfText = line->lineStr;
-
-    if (*line->lineStr == ';')
-    {
-        return TRUE; /* Return true if the line is a comment. */
-    }
+const unsigned char g_digitValues[256] =
+{   /* The value of every digit char, 0 - 9 and a - f / A - F, and 16 for any other char. */
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 16, 16, 16, 16, 16, 16,
+    16, 10, 11, 12, 13, 14, 15, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 10, 11, 12, 13, 14, 15, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16
+};
 
-    trimLeftStr(&startOfText);
-    if (*startOfText == '\0')
-    {
-        return TRUE; /* Return true if the line is empty. */
-    }
-    if (*startOfText == ';')
-    {
-        printError(line->lineNum, "ERROR: Comments must start with ';' at the start of the line.");
-        line->isError = TRUE; /* Mark the line as an error. */
-        return TRUE;
-    }
-
-    return FALSE;
-}
-
-char *getFirstOperand(char *line, char **endOfOp, boolean *foundComma)
+boolean isLegalNum(char *numStr, int numOfBits, int lineNum, int *value)
 {
-    if (!isWhiteSpaces(line))
-    {
-        char *end = strchr(line, ','); /* Find the first comma. */
-        if (end)
-        {
-            *foundComma = TRUE;
-            *end = '\0'; /* Null-terminate the operand. */
-            end++;
-        }
-        else
-        {
-            *foundComma = FALSE;
-        }
+    char *digit = numStr, *firstDigit;
+    int maxNum = (1 << numOfBits) - 1; /* Calculate the maximum number that can be represented. */
+    int base = 10, digitValue;
+    long number = 0;
+    boolean isNegative = FALSE;
 
-        if (endOfOp)
-        {
-            if (end)
-            {
-                *endOfOp = end;
-            }
-            else
-            {
-                *endOfOp = strchr(line, '\0'); /* Set endOfOp to the end of the line. */
-            }
-        }
+    if (*numStr == '\0')
+    {
+        printError(lineNum, "ERROR: Empty parameter.");
+        return FALSE;
     }
 
-    trimStr(&line); /* Remove leading and trailing whitespace from the operand. */
-    return line;
-}
-
-boolean isDirective(char *cmd)
-{
-    return (*cmd == '.') ? TRUE : FALSE;
-}
-
-boolean isLegalStringParam(char **strParam, int lineNum)
-{
-    if ((*strParam)[0] == '"' && (*strParam)[strlen(*strParam) - 1] == '"')
+    if (*digit == '-' || *digit == '+')
     {
-        (*strParam)[strlen(*strParam) - 1] = '\0'; /* Remove the ending quote. */
-        ++*strParam; /* Remove the starting quote. */
-        return TRUE;
+        isNegative = (*digit == '-');
+        digit++;
     }
-
-    if (**strParam == '\0')
+    if (digit[0] == '0' && (digit[1] == 'x' || digit[1] == 'X') && g_digitValues[(unsigned char)digit[2]] < 16) /* The same prefixes as strtol with base 0. */
     {
-        printError(lineNum, "ERROR: No parameter.");
+        base = 16;
+        digit += 2;
     }
-    else
+    else if (digit[0] == '0')
     {
-        printError(lineNum, "ERROR: The parameter for .string must be enclosed in quotes.");
+        base = 8;
     }
-    return FALSE;
-}
-
-boolean isLegalNum(char *numStr, int numOfBits, int lineNum, int *value)
-{
-    char *endOfNum;
-    int maxNum = (1 << numOfBits) - 1; /* Calculate the maximum number that can be represented. */
 
-    if (isWhiteSpaces(numStr))
+    firstDigit = digit;
+    while ((digitValue = g_digitValues[(unsigned char)*digit]) < base) /* The number stops growing once it is out of range, so it can't overflow. */
     {
-        printError(lineNum, "ERROR: Empty parameter.");
-        return FALSE;
+        if (number <= maxNum)
+        {
+            number = number * base + digitValue;
+        }
+        digit++;
     }
 
-    *value = strtol(numStr, &endOfNum, 0); /* Convert the string to a number. */
-
-    if (*endOfNum)
+    if (digit == firstDigit || *digit)
     {
         printError(lineNum, "ERROR: \"%s\" isn't a valid number.", numStr);
         return FALSE;
     }
 
-    if (*value > maxNum || *value < -maxNum)
+    if (number > maxNum)
     {
-        printError(lineNum, "ERROR: \"%s\" is too %s, must be between %d and %d.", numStr, (*value > 0) ? "big" : "small", -maxNum, maxNum);
+        printError(lineNum, "ERROR: \"%s\" is too %s, must be between %d and %d.", numStr, isNegative ? "small" : "big", -maxNum, maxNum);
         return FALSE;
     }
 
+    *value = isNegative ? (int)-number : (int)number;
     return TRUE;
 }
 
@@ -543,9 +724,9 @@ FILE *openFile(char *name, char *ending, const char *mode)
     return file;
 }
 
-char *stripExtension(char *filename, const char *extension)
+char *stripExtension(memoryArena *memory, char *filename, const char *extension)
 {
-    char *new_filename = stringDuplicate(filename);
+    char *new_filename = arenaStringDuplicate(memory, filename); /* The string lives until the arena is reset. */
     char *ext_pos = strstr(new_filename, extension);
     if (ext_pos != NULL)
     {
@@ -554,12 +735,12 @@ char *stripExtension(char *filename, const char *extension)
     return new_filename;
 }
 
-void createObjectFile(char *name, int IC, int DC, int *memoryArr)
+void createObjectFile(assemblerContext *context, char *name, int IC, int DC)
 {
     int i;
     FILE *file;
     char *base_name;
-    base_name = stripExtension(name, ".am"); /* Creates the new ".ob" file without the ".am" extension. */
+    base_name = stripExtension(&context->memory, name, ".am"); /* Creates the new ".ob" file without the ".am" extension. */
     file = openFile(base_name, ".ob", "w");
 
     fprintfICDC(file, IC); /* Print the IC value. */
@@ -571,32 +752,32 @@ void createObjectFile(char *name, int IC, int DC, int *memoryArr)
         fprintf(file, "\n");
         fprintfDest(file, INITIAL_ADDRESS + i); /* Print the memory address. */
         fprintf(file, "\t\t");
-        fprintfData(file, memoryArr[i]); /* Print the data in octal format. */
+        fprintfData(file, context->image[i]); /* Print the data in octal format. */
     }
 
     fclose(file);
 }
 
-void createEntriesFile(char *name)
+void createEntriesFile(assemblerContext *context, char *name)
 {
     int i;
     FILE *file;
     char *base_name;
 
-    if (!g_entryLabelsCount)
+    if (!context->entryLabelsCount)
     {
         return; /* Return if there are no entry labels. */
     }
 
-    base_name = stripExtension(name, ".am"); /* Creates the new ".ent" file without the ".am" extension. */
+    base_name = stripExtension(&context->memory, name, ".am"); /* Creates the new ".ent" file without the ".am" extension. */
     file = openFile(base_name, ".ent", "w");
 
-    for (i = 0; i < g_entryLabelsCount; i++)
+    for (i = 0; i < context->entryLabelsCount; i++)
     {
-        fprintf(file, "%s\t\t", g_entryLinesArr[i]->lineStr); /* Print the entry label name. */
-        fprintfEnt(file, getLabel(g_entryLinesArr[i]->lineStr)->address); /* Print the entry label address. */
+        fprintf(file, "%s\t\t", context->names.names[context->entryLabels[i]->nameId]); /* Print the entry label name. */
+        fprintfEnt(file, context->entryLabels[i]->address); /* Print the entry label address. */
 
-        if (i != g_entryLabelsCount - 1)
+        if (i != context->entryLabelsCount - 1)
         {
             fprintf(file, "\n");
         }
@@ -605,98 +786,83 @@ void createEntriesFile(char *name)
     fclose(file);
 }
 
-void createExternFile(char *name, lineInfo *linesArr, int linesCount)
+FILE *writeExternReference(assemblerContext *context, FILE *file, char *name, labelInfo *label, int address)
 {
-    int i;
-    labelInfo *label;
-    boolean firstPrint = TRUE; /* Flag to indicate if this is the first extern label. */
-    FILE *file = NULL;
     char *base_name;
 
-    for (i = 0; i < linesCount; i++)
+    if (!label || !label->isExtern)
     {
-        if (linesArr[i].cmd && linesArr[i].cmd->numOfParams >= 2 && linesArr[i].op1.type == OP_LABEL)
-        {
-            label = getLabel(linesArr[i].op1.str);
-            if (label && label->isExtern)
-            {
-                if (firstPrint)
-                {
-                    base_name = stripExtension(name, ".am"); /* Creates the new ".ext" file without the ".am" extension. */
-                    file = openFile(base_name, ".ext", "w"); /* Open the file for writing. */
-                }
-                else
-                {
-                    fprintf(file, "\n");
-                }
-
-                fprintf(file, "%s\t\t", label->name); /* Print the extern label name. */
-                fprintfExt(file, linesArr[i].op1.address); /* Print the extern label address. */
-                firstPrint = FALSE;
-            }
-        }
-
-        if (linesArr[i].cmd && linesArr[i].cmd->numOfParams >= 1 && linesArr[i].op2.type == OP_LABEL)
-        {
-            label = getLabel(linesArr[i].op2.str);
-            if (label && label->isExtern)
-            {
-                if (firstPrint)
-                {
-                    base_name = stripExtension(name, ".am"); /* Creates the new ".ext" file without the ".am" extension. */
-                    file = openFile(base_name, ".ext", "w"); /* Open the file for writing. */
-                }
-                else
-                {
-                    fprintf(file, "\n");
-                }
-
-                fprintf(file, "%s\t\t", label->name); /* Print the extern label name. */
-                fprintfExt(file, linesArr[i].op2.address); /* Print the extern label address. */
-                firstPrint = FALSE;
-            }
-        }
+        return file;
     }
 
-    if (file)
+    if (!file)
     {
-        fclose(file);
+        base_name = stripExtension(&context->memory, name, ".am"); /* Creates the new ".ext" file without the ".am" extension. */
+        file = openFile(base_name, ".ext", "w"); /* Open the file for writing. */
+    }
+    else
+    {
+        fprintf(file, "\n");
     }
+
+    fprintf(file, "%s\t\t", context->names.names[label->nameId]); /* Print the extern label name. */
+    fprintfExt(file, address); /* Print the extern label address. */
+    return file;
 }
 
-void clearData(lineInfo *linesArr, int linesCount, int dataCount)
+void createExternFile(assemblerContext *context, char *name, instructionTable *instructions, fixupList *fixups)
 {
     int i;
+    FILE *file = NULL;
 
-    for (i = 0; i < g_labelCount; i++)
+    for (i = 0; instructions && i < instructions->count; i++) /* The operand words follow the command word, the source word comes first. */
     {
-        g_labelsArr[i].address = 0;
-        g_labelsArr[i].isData = 0;
-        g_labelsArr[i].isExtern = 0;
+        file = writeExternReference(context, file, name, instructions->srcLabels[i], instructions->addresses[i] + 1);
+        file = writeExternReference(context, file, name, instructions->destLabels[i], instructions->addresses[i] + (instructions->srcModes[i] ? 2 : 1));
     }
-    g_labelCount = 0;
 
-    for (i = 0; i < g_entryLabelsCount; i++)
+    for (i = 0; fixups && i < fixups->count; i++) /* In single pass mode every label operand word has a fixup. */
     {
-        g_entryLinesArr[i] = NULL;
+        file = writeExternReference(context, file, name, fixups->fixups[i].label, INITIAL_ADDRESS + fixups->fixups[i].wordIndex);
     }
-    g_entryLabelsCount = 0;
 
-    for (i = 0; i < dataCount; i++)
+    if (file)
     {
-        g_arr[i] = 0;
+        fclose(file);
     }
+}
 
-    for (i = 0; i < linesCount; i++)
-    {
-        free(linesArr[i].originalString); /* Free the original string allocated for each line. */
-    }
+void initContext(assemblerContext *context)
+{
+    initArena(&context->memory);
+    initInternTable(&context->names, &context->memory);
+    initLabelTable(&context->labels, &context->memory);
+    context->entryLabels = NULL;
+    context->entryLabelsCount = 0;
+    context->entryLabelsCapacity = 0;
+}
+
+void resetContext(assemblerContext *context)
+{
+    context->entryLabels = NULL; /* The array is in the arena. */
+    context->entryLabelsCount = 0;
+    context->entryLabelsCapacity = 0;
+
+    /* The data and the image aren't cleared, every word up to DC and IC + DC is written before it is read. */
+    resetArena(&context->memory); /* Release everything that was allocated for the file, the labels and names too. */
+    initInternTable(&context->names, &context->memory);
+    initLabelTable(&context->labels, &context->memory);
+}
+
+void freeContext(assemblerContext *context)
+{
+    freeArena(&context->memory);
 }
 
-char *addNewFile(char *file_name, char *new_extension)
+char *addNewFile(memoryArena *memory, char *file_name, char *new_extension)
 {
     char *dot_position, *new_file_name;
-    new_file_name = allocateMemory(strlen(file_name) + strlen(new_extension) + 1);
+    new_file_name = arenaAllocate(memory, strlen(file_name) + strlen(new_extension) + 1);
 
     strcpy(new_file_name, file_name);
 
@@ -710,172 +876,264 @@ char *addNewFile(char *file_name, char *new_extension)
     return new_file_name;
 }
 
-int copyFile(char *file_name_dest, char *file_name_orig)
+void initTextBuffer(textBuffer *buffer)
 {
-    char str[LINE_MAX_LENGTH];
-    FILE *fp, *fp_dest;
+    buffer->capacity = LINE_MAX_LENGTH + 1;
+    buffer->data = allocateMemory(buffer->capacity);
+    buffer->data[0] = '\0';
+    buffer->length = 0;
+}
 
-    fp = fopen(file_name_orig, "r"); /* Open the source file for reading. */
-    if (fp == NULL)
+void appendToTextBuffer(textBuffer *buffer, const char *str)
+{
+    appendCharsToTextBuffer(buffer, str, strlen(str));
+}
+
+void appendCharsToTextBuffer(textBuffer *buffer, const char *str, size_t length)
+{
+    if (buffer->length + length + 1 > buffer->capacity) /* Grow the buffer when the text doesn't fit. */
     {
-        logAndExitOnInternalError("ERROR: Failed to open file for reading");
-        return 0;
+        char *new_data;
+        while (buffer->length + length + 1 > buffer->capacity)
+        {
+            buffer->capacity *= 2;
+        }
+        new_data = (char *)realloc(buffer->data, buffer->capacity);
+        if (!new_data)
+        {
+            logAndExitOnInternalError("ERROR: Allocation of memory failed");
+        }
+        buffer->data = new_data;
     }
 
-    fp_dest = fopen(file_name_dest, "w"); /* Open the destination file for writing. */
-    if (fp_dest == NULL)
+    memcpy(buffer->data + buffer->length, str, length); /* Copy the chars and end the text after them. */
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+}
+
+void clearTextBuffer(textBuffer *buffer)
+{
+    buffer->length = 0;
+    buffer->data[0] = '\0';
+}
+
+void freeTextBuffer(textBuffer *buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = buffer->capacity = 0;
+}
+
+int writeTextBufferToFile(char *file_name, textBuffer *buffer)
+{
+    FILE *fp = fopen(file_name, "w"); /* Open the destination file for writing. */
+    if (fp == NULL)
     {
-        logAndExitOnInternalError("ERROR: Failed to open new file for writing");
-        fclose(fp);
         return 0;
     }
 
-    while (fgets(str, LINE_MAX_LENGTH, fp) != NULL) /* Read each line from the source file. */
-    {
-        fprintf(fp_dest, "%s", str); /* Write each line to the destination file. */
-    }
+    fwrite(buffer->data, 1, buffer->length, fp); /* Write the whole text at once. */
+    fclose(fp);
+    return 1;
+}
+
+void initLineMap(lineMap *map, memoryArena *memory)
+{
+    map->lines = NULL;
+    map->count = 0;
+    map->capacity = 0;
+    map->memory = memory;
+}
 
-    fclose(fp); /* Close the source file. */
-    fclose(fp_dest); /* Close the destination file. */
+void addLineToMap(lineMap *map, int lineNum)
+{
+    int *old = map->lines;
 
-    return 1;
+    if (map->count >= map->capacity) /* The old array is released with the arena. */
+    {
+        map->capacity = map->capacity ? map->capacity * 2 : LINE_MAP_INITIAL_SIZE;
+        map->lines = (int *)arenaAllocate(map->memory, map->capacity * sizeof(int));
+        if (map->count)
+        {
+            memcpy(map->lines, old, map->count * sizeof(int));
+        }
+    }
+    map->lines[map->count++] = lineNum;
 }
 
 
 /*********************
-****Text Handling*****
+***Memory Handling****
 *********************/
 
-int tabOrSpaceCheck(char c)
+void initArena(memoryArena *memory)
 {
-    return (isspace(c) && c != '\n'); /* Check if the character is a tab or a space. */
+    memory->head = NULL;
 }
 
-void removeSpacesNearComma(char *str)
+void *arenaAllocate(memoryArena *memory, size_t size)
 {
-    char *ptr = str;
-    if (*ptr == ',')
+    arenaBlock *block = memory->head;
+    char *ptr;
+
+    size = (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT; /* Keep the next allocation aligned. */
+
+    if (!block || block->used + size > block->size) /* Start a new block when the current one is full. */
+    {
+        size_t block_size = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+        block = (arenaBlock *)allocateMemory(ARENA_HEADER_SIZE + block_size);
+        block->size = block_size;
+        block->used = 0;
+        block->next = memory->head;
+        memory->head = block;
+    }
+
+    ptr = (char *)block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void *arenaAllocateZeroed(memoryArena *memory, size_t size)
+{
+    void *ptr = arenaAllocate(memory, size);
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void resetArena(memoryArena *memory)
+{
+    arenaBlock *block;
+
+    if (!memory->head)
     {
         return;
     }
 
-    while ((ptr = strchr(ptr, ',')) != NULL)
+    while (memory->head->next) /* Keep only the current block, empty. */
     {
-        if (*(ptr - 1) == ' ') /* Check for spaces before comma. */
-        {
-            memmove(ptr - 1, ptr, strlen(ptr) + 1); /* Removes space before the comma. */
-            if (*(ptr) == ' ')
-            {
-                memmove(ptr, ptr + 1, strlen(ptr + 1) + 1); /* Removes space after the comma. */
-            }
-        }
-        else if (*(ptr + 1) == ' ')
-        {
-            memmove(ptr + 1, ptr + 2, strlen(ptr + 2) + 1); /* Moves the string starting from ptr + 2 one position to the left to ptr + 1. */
-            ptr++;
-        }
-        else
-        {
-            ptr++;
-        }
+        block = memory->head->next;
+        memory->head->next = block->next;
+        free(block);
     }
+    memory->head->used = 0;
 }
 
-void removeExtraSpacesString(char str[])
+void freeArena(memoryArena *memory)
 {
-    char str_temp[LINE_MAX_LENGTH];
-    int source_i, dest_i;
-    source_i = dest_i = 0;
+    arenaBlock *block;
 
-    while (tabOrSpaceCheck(*(str + source_i))) /* Remove space where the line starts. */
+    while (memory->head)
     {
-        source_i++;
+        block = memory->head;
+        memory->head = block->next;
+        free(block);
     }
-    while (*(str + source_i) != '\0') /* As long as we are not at the end. */
+}
+
+
+/*********************
+****Text Handling*****
+*********************/
+
+const unsigned char g_charKinds[256] =
+{   /* CharKind of every char: \0 and \n end the line, \t \v \f \r and ' ' are spaces. */
+    3, 0, 0, 0, 0, 0, 0, 0, 0, 1, 3, 1, 1, 1, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+size_t removeExtraSpacesString(char str[], size_t length)
+{
+    char *source = str, *dest = str, *end = str + length;
+    boolean pendingSpace = FALSE, removeNearComma = TRUE;
+    unsigned long word;
+    int kind;
+
+    INFINITE_LOOP
     {
-        while (!tabOrSpaceCheck(*(str + source_i)) && *(str + source_i) != '\0')
+        kind = g_charKinds[(unsigned char)*source];
+
+        if (kind == CHAR_SPACE) /* Skip the whole run of spaces, a word at a time while whole words are spaces. */
         {
-            *(str_temp + dest_i) = *(str + source_i);
-            source_i++;
-            dest_i++;
+            while (source + sizeof(word) <= end)
+            {
+                memcpy(&word, source, sizeof(word));
+                if (word != SPACES_WORD)
+                {
+                    break;
+                }
+                source += sizeof(word);
+            }
+            while (g_charKinds[(unsigned char)*source] == CHAR_SPACE)
+            {
+                source++;
+            }
+            pendingSpace = (dest != str); /* Spaces at the start of the line are removed. */
+            continue;
         }
-        if (*(str + source_i) == '\0') /* If we reached the end line. */
+
+        /* A run of spaces becomes a single space, unless it ends the line or touches a comma. */
+        if (pendingSpace && kind != CHAR_END && !(removeNearComma && (kind == CHAR_COMMA || dest[-1] == ',')))
         {
-            break;
+            *dest++ = ' ';
         }
-        while (tabOrSpaceCheck(*(str + source_i))) /* Skipping white spaces until we encounter another char. */
+        pendingSpace = FALSE;
+
+        if (kind == CHAR_END)
         {
-            source_i++;
+            break;
         }
-        if (!(*(str + source_i) == '\n' || *(str + source_i) == '\0')) /* Reached end of line, copy a single space for those who were skipped. */
+        if (dest == str && kind == CHAR_COMMA) /* A line that starts with a comma keeps the spaces around its commas. */
         {
-            *(str_temp + dest_i) = ' ';
-            dest_i++;
+            removeNearComma = FALSE;
         }
+        *dest++ = *source++;
+    }
+
+    if (*source == '\n')
+    {
+        *dest++ = '\n';
     }
-    *(str_temp + dest_i) = *(str + source_i);
-    *(str_temp + dest_i + 1) = '\0';
-    removeSpacesNearComma(str_temp);
-    strcpy(str, str_temp);
+    *dest = '\0';
+    return dest - str;
 }
 
-/* Function to remove extra spaces from a file */
-char *removeExtraSpacesFile(char file_name[])
+int readNormalizedLine(FILE *source_pointer, char *str, int line_number, char *file_name)
 {
-    char str[LINE_MAX_LENGTH + 2]; /* +2 for \n and \0 */
-    char *new_file_name;
-    int line_number;
-    FILE *source_pointer, *source_pointer_temp;
+    size_t length;
 
-    source_pointer = fopen(file_name, "r"); /* Open file for reading. */
-    if (source_pointer == NULL)
+    if (fgets(str, LINE_MAX_LENGTH + 2, source_pointer) == NULL)
     {
-        printf("ERROR: Failed to open the source file \"%s\" for reading.\n", file_name);
-        return NULL;
+        return 0; /* Reached the end of the file. */
     }
 
-    new_file_name = addNewFile(file_name, ".temp1"); /* Creating new file name for the temporary file. */
-    if (new_file_name == NULL)
+    length = strlen(str);
+    if (length > LINE_MAX_LENGTH)
     {
-        fclose(source_pointer);
-        printf("ERROR: Failed to allocate memory for the new file name.\n");
-        return NULL;
+        printf("ERROR: Line %d in file \"%s\" is too long.\n", line_number, file_name);
+        return -1;
     }
-
-    source_pointer_temp = fopen(new_file_name, "w"); /* Open the temporary file for writing. */
-    if (source_pointer_temp == NULL)
+    else if (*str == ';') /* Handle comment lines */
     {
-        fclose(source_pointer);
-        free(new_file_name);
-        printf("ERROR: Failed to open the temporary file \"%s\" for writing.\n", new_file_name);
-        return NULL;
+        *str = '\n'; /* Replace comment line with a new line. */
+        *(str + 1) = '\0';
     }
-
-    line_number = 0;
-    while (fgets(str, LINE_MAX_LENGTH + 2, source_pointer) != NULL)
+    else
     {
-        line_number++;
-        if (strlen(str) > LINE_MAX_LENGTH)
-        {
-            printf("ERROR: Line %d in file \"%s\" is too long.\n", line_number, file_name);
-            fclose(source_pointer);
-            fclose(source_pointer_temp);
-            free(new_file_name);
-            return NULL;
-        }
-        else if (*str == ';') /* Handle comment lines */
-        {
-            *str = '\n'; /* Replace comment line with a new line. */
-            *(str + 1) = '\0';
-        }
-        else
-        {
-            removeExtraSpacesString(str); /* Remove extra white spaces from the line. */
-        }
-        fprintf(source_pointer_temp, "%s", str); /* Save changes to the temporary file. */
+        removeExtraSpacesString(str, length); /* Remove extra white spaces from the line. */
     }
-
-    fclose(source_pointer); /* Close the source file. */
-    fclose(source_pointer_temp); /* Close the temporary file. */
-    return new_file_name;
-}
\ No newline at end of file
+    return 1;
+}
@@ -0,0 +1,240 @@
+/* Name: Almog Hakak, ID: 211825229 */
+
+#include "lexer.h"
+
+const unsigned char g_lexClasses[256] =
+{   /* LexClass of every char: '0' - '7' are the register numbers (NUM_OF_REG is 7), \t \n \v \f \r and ' ' are spaces. */
+    2, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 9, 0, 0, 0, 0, 0, 0, 10, 0, 3, 0, 0, 0,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 8, 4, 0, 0, 0, 0, 0,
+    0, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 0, 0, 0, 0, 0,
+    0, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 6, 5, 5, 5, 5, 5, 5, 5, 5, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+const unsigned char g_operandStates[OPS_STATES][LEX_CLASSES] =
+{   /* OTHER SPACE END COMMA COLON LETTER R REG_DIGIT DIGIT HASH STAR */
+    { 8, 8, 8, 8, 8, 7, 5, 8, 8, 1, 2 }, /* OPS_EMPTY */
+    { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 }, /* OPS_IMMEDIATE, the number is checked by isLegalNum. */
+    { 8, 8, 8, 8, 8, 8, 3, 8, 8, 8, 8 }, /* OPS_STAR */
+    { 8, 8, 8, 8, 8, 8, 8, 4, 8, 8, 8 }, /* OPS_STAR_R */
+    { 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8 }, /* OPS_INDIRECT_REG */
+    { 8, 8, 8, 8, 8, 7, 7, 6, 7, 8, 8 }, /* OPS_R */
+    { 8, 8, 8, 8, 8, 7, 7, 7, 7, 8, 8 }, /* OPS_REGISTER */
+    { 8, 8, 8, 8, 8, 7, 7, 7, 7, 8, 8 }, /* OPS_IDENTIFIER */
+    { 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8 }  /* OPS_INVALID */
+};
+
+/* The token kind of every final state of the operand automaton. */
+const TokenKind g_operandKinds[OPS_STATES] =
+{
+    TOK_EMPTY, TOK_IMMEDIATE, TOK_INVALID, TOK_INVALID, TOK_INDIRECT_REG, TOK_IDENTIFIER, TOK_REGISTER, TOK_IDENTIFIER, TOK_INVALID
+};
+
+LineKind tokenizeLine(char *lineStr, lineTokens *tokens)
+{
+    char *cursor = lineStr, *wordStart, *wordEnd;
+    boolean stopAtComma = TRUE, foundComma;
+    lineToken operand;
+    int id;
+
+    tokens->count = 0;
+    tokens->next = 0;
+
+    if (*cursor == ';')
+    {
+        return LINE_EMPTY; /* A comment. */
+    }
+    while (g_lexClasses[(unsigned char)*cursor] == LEX_SPACE)
+    {
+        cursor++;
+    }
+    if (*cursor == '\0')
+    {
+        return LINE_EMPTY;
+    }
+    if (*cursor == ';')
+    {
+        return LINE_BAD_COMMENT;
+    }
+
+    /* The first word is a label when a ':' ends it (spaces before the ':' are a part of the label). */
+    wordStart = cursor;
+    while (g_lexClasses[(unsigned char)*cursor] != LEX_SPACE && g_lexClasses[(unsigned char)*cursor] != LEX_END && *cursor != ':')
+    {
+        cursor++;
+    }
+    wordEnd = cursor;
+    while (g_lexClasses[(unsigned char)*cursor] == LEX_SPACE)
+    {
+        cursor++;
+    }
+
+    if (*cursor == ':')
+    {
+        *cursor++ = '\0';
+        addToken(tokens, TOK_LABEL_DEF, lineStr, 0);
+
+        while (g_lexClasses[(unsigned char)*cursor] == LEX_SPACE) /* The command is the next word, up to a space. */
+        {
+            cursor++;
+        }
+        wordStart = cursor;
+        while (g_lexClasses[(unsigned char)*cursor] != LEX_SPACE && g_lexClasses[(unsigned char)*cursor] != LEX_END)
+        {
+            cursor++;
+        }
+        wordEnd = cursor;
+    }
+
+    if (*wordEnd != '\0') /* End the command in place, the operands start after it. */
+    {
+        if (cursor == wordEnd)
+        {
+            cursor++;
+        }
+        *wordEnd = '\0';
+    }
+
+    if (*wordStart == '.')
+    {
+        id = getDircId(wordStart + 1);
+        stopAtComma = (id == -1 || !g_dircArr[id].isWholeOperand);
+        addToken(tokens, TOK_DIRECTIVE, wordStart + 1, id);
+    }
+    else
+    {
+        addToken(tokens, TOK_MNEMONIC, wordStart, getCmdId(wordStart));
+    }
+
+    if (!stopAtComma) /* A single operand, the rest of the line. */
+    {
+        tokenizeOperand(cursor, FALSE, &operand, &foundComma);
+        addToken(tokens, operand.kind, operand.str, operand.value);
+        return LINE_CODE;
+    }
+
+    INFINITE_LOOP /* An operand and the comma after it, until only spaces are left. */
+    {
+        cursor = tokenizeOperand(cursor, TRUE, &operand, &foundComma);
+        if (operand.kind == TOK_EMPTY && !foundComma)
+        {
+            break;
+        }
+        addToken(tokens, operand.kind, operand.str, operand.value);
+        if (!foundComma)
+        {
+            break;
+        }
+        addToken(tokens, TOK_COMMA, ",", 0);
+    }
+    return LINE_CODE;
+}
+
+char *tokenizeOperand(char *cursor, boolean stopAtComma, lineToken *token, boolean *foundComma)
+{
+    char *last = NULL;
+    boolean pendingSpace = FALSE;
+    int state = OPS_EMPTY, lexClass;
+
+    while (g_lexClasses[(unsigned char)*cursor] == LEX_SPACE)
+    {
+        cursor++;
+    }
+    token->str = cursor;
+
+    INFINITE_LOOP /* Run the operand automaton, spaces only count when text follows them. */
+    {
+        lexClass = g_lexClasses[(unsigned char)*cursor];
+        if (lexClass == LEX_END || (lexClass == LEX_COMMA && stopAtComma))
+        {
+            break;
+        }
+        if (lexClass == LEX_SPACE)
+        {
+            pendingSpace = TRUE;
+        }
+        else
+        {
+            if (pendingSpace)
+            {
+                state = g_operandStates[state][LEX_SPACE];
+                pendingSpace = FALSE;
+            }
+            state = g_operandStates[state][lexClass];
+            last = cursor;
+        }
+        cursor++;
+    }
+
+    *foundComma = (*cursor == ',');
+    if (*foundComma)
+    {
+        cursor++;
+    }
+
+    token->kind = g_operandKinds[state];
+    token->value = 0;
+    if (!last) /* End the operand after its last char. */
+    {
+        *token->str = '\0';
+        return cursor;
+    }
+    last[1] = '\0';
+
+    if (token->kind == TOK_REGISTER)
+    {
+        token->value = token->str[1] - '0';
+    }
+    else if (token->kind == TOK_INDIRECT_REG)
+    {
+        token->value = token->str[2] - '0';
+    }
+    else if (!stopAtComma && *token->str == '"' && *last == '"') /* A single '"' is an empty string too. */
+    {
+        token->kind = TOK_STRING;
+        token->value = (last > token->str) ? (int)(last - token->str) - 1 : 0;
+    }
+    return cursor;
+}
+
+void addToken(lineTokens *tokens, TokenKind kind, char *str, int value)
+{
+    if (tokens->count < LINE_TOKENS_MAX)
+    {
+        tokens->tokens[tokens->count].kind = kind;
+        tokens->tokens[tokens->count].str = str;
+        tokens->tokens[tokens->count].value = value;
+        tokens->count++;
+    }
+}
+
+lineToken *peekToken(lineTokens *tokens)
+{
+    return (tokens->next < tokens->count) ? &tokens->tokens[tokens->next] : NULL;
+}
+
+lineToken *nextToken(lineTokens *tokens)
+{
+    return (tokens->next < tokens->count) ? &tokens->tokens[tokens->next++] : NULL;
+}
+
+boolean acceptComma(lineTokens *tokens)
+{
+    if (tokens->next < tokens->count && tokens->tokens[tokens->next].kind == TOK_COMMA)
+    {
+        tokens->next++;
+        return TRUE;
+    }
+    return FALSE;
+}
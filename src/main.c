@@ -7,25 +7,31 @@
 #include "first_pass.h"
 #include "second_pass.h"
 
-int g_entryLabelsCount = 0;            /* Counter of entry labels. */
-int g_labelCount = 0;                  /* Counter of labels. */
-int g_arr[RAM_LIMIT];                  /* Array to store data values. */
-lineInfo *g_entryLinesArr[LABELS_MAX]; /* Array of pointers to lineInfo structures for entry lines. */
-labelInfo g_labelsArr[LABELS_MAX];     /* Array of labelInfo structures to store labels. */
-
 
 /**
  * Processes the input file and performs assembly operations.
+ * Options apply to the files that come after them:
+ * -n  Don't write the .am file of the preprocessed source.
+ * -c name  Compile the macro definitions of name.as into the macro library name.ml.
+ * -l name  Load the macro library name.ml, its macros can be used by the files that follow.
+ * -D name  Define a symbol for the .ifdef and .ifndef directives.
+ * -s  Assemble in a single pass, the label operands are patched once the labels are known.
  * @param argc Number of command-line arguments
  * @param argv Array of command-line argument strings
  * @return 0 on successful completion, non-zero on error
  */
 int main(int argc, char *argv[])
 {
-    int IC = 0, DC = 0, errorsCount = 0, linesCount = 0, ramArr[RAM_LIMIT] = {0}, i;
-    char *source_file, *macro_file, *temp_file, macroFileName[FILENAME_MAX_LENGTH];
-    lineInfo linesArr[LINES_MAX_LENGTH];
-    FILE *file;
+    int IC = 0, DC = 0, errorsCount = 0, i;
+    boolean writeMacroFile = TRUE, useLibrary = FALSE, singlePass = FALSE;
+    char *source_file, *macro_file, *library_file;
+    assemblerContext context;      /* The state of the file that is being assembled, reset after every file. */
+    instructionTable instructions; /* The valid instructions of the file, in the arena of the file. */
+    fixupList fixups;            /* The label operands of the file in single pass mode. */
+    textBuffer program;
+    macroLibrary library;
+    macroTable symbols;          /* Symbols that were defined with -D. */
+    memoryArena symbolsMemory;
 
     if (argc < 2)
     {
@@ -33,62 +39,93 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    initContext(&context);
+    initArena(&library.memory);
+    initArena(&symbolsMemory);
+    initMacroTable(&symbols, &symbolsMemory);
+
     /* Main loop on each File*/
     for (i = 1; i < argc; i++)
     {
-        printf("Starting preprocessor \n");
-        source_file = addNewFile(argv[i], ".as");       /* Creates a file with ".as". */
-        temp_file = removeExtraSpacesFile(source_file); /* Handling spaces in the source file. */
-
-        /* Handling error in allocation memory */
-        if (!temp_file)
+        if (strcmp(argv[i], "-n") == 0) /* The .am files of the next sources aren't needed. */
         {
-            free(source_file);
+            writeMacroFile = FALSE;
             continue;
         }
-
-        /* Run the macro preprocessor on the temp file, handle errors in current file. */
-        if (!processMacros(temp_file))
+        if (strcmp(argv[i], "-s") == 0) /* The next sources are assembled in a single pass. */
         {
-            free(source_file);
-            free(temp_file);
+            singlePass = TRUE;
             continue;
         }
-
-        printf("Starting first pass\n");
-        macro_file = addNewFile(argv[i], ".am"); /* Creates a file with ".am". */
-        remove(temp_file);
-        file = fopen(macro_file, "r");           /* Opens macro file in reading mode. */
-        
-         /* Handling error */
-        if (!file) 
+        if (strcmp(argv[i], "-D") == 0) /* Symbol for the conditional directives. */
         {
-            printf("ERROR: File cant be open \"%s\".\n", macro_file);
-            free(source_file);
-            free(macro_file);
+            if (i + 1 >= argc)
+            {
+                printf("ERROR: No symbol was given after -D.\n");
+                break;
+            }
+            addMacro(&symbols, argv[++i], "", 0);
+            continue;
+        }
+        if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "-l") == 0) /* Macro library options. */
+        {
+            if (i + 1 >= argc)
+            {
+                printf("ERROR: No library was given after %s.\n", argv[i]);
+                break;
+            }
+            i++;
+            library_file = addNewFile(&context.memory, argv[i], ".ml");
+            if (strcmp(argv[i - 1], "-c") == 0)
+            {
+                source_file = addNewFile(&context.memory, argv[i], ".as"); /* Only a compiled library is read from its source. */
+                compileMacroLibrary(source_file, library_file, &symbols, &context.memory);
+            }
+            else
+            {
+                useLibrary = loadMacroLibrary(library_file, &library);
+            }
+            resetContext(&context);
             continue;
         }
 
-        clearData(linesArr, linesCount, IC + DC); /* Reset data. */
-        sprintf(macroFileName, "%s", macro_file);
+        printf("Starting preprocessor \n");
+        source_file = addNewFile(&context.memory, argv[i], ".as"); /* Creates a file with ".as". */
+        macro_file = addNewFile(&context.memory, argv[i], ".am");  /* Creates a file with ".am". */
+        initTextBuffer(&program);
 
-        file = fopen(macroFileName, "r");
-        if (file == NULL)
+        /* Run the preprocessor on the source file in memory, handle errors in current file. */
+        if (!processMacros(source_file, writeMacroFile ? macro_file : NULL, &symbols, useLibrary ? &library : NULL, &program, &context.memory))
         {
-            printf("ERROR: Can't open the file \"%s\".\n", macroFileName);
-            return 1;
+            freeTextBuffer(&program);
+            resetContext(&context);
+            continue;
         }
 
-        errorsCount += firstPass(file, linesArr, &linesCount, &IC, &DC);
+        printf("Starting first pass\n");
+        IC = DC = errorsCount = 0;
+        if (singlePass)
+        {
+            initFixupList(&fixups, context.image, &context.memory);
+            errorsCount += firstPass(&context, program.data, NULL, &fixups, &IC, &DC);
+
+            printf("Patching label operands\n");
+            errorsCount += patchFixups(&context, &fixups, IC, DC);
+        }
+        else
+        {
+            initInstructionTable(&instructions, &context.memory);
+            errorsCount += firstPass(&context, program.data, &instructions, NULL, &IC, &DC);
 
-        printf("Starting second pass\n");
-        errorsCount += secondPass(ramArr, linesArr, linesCount, IC, DC);
+            printf("Starting second pass\n");
+            errorsCount += secondPass(&context, &instructions, IC, DC);
+        }
 
         if (errorsCount == 0)
         {
-            createObjectFile(macro_file, IC, DC, ramArr);    /* .ob file creation. */
-            createExternFile(macro_file, linesArr, linesCount); /* .ext file creation. */
-            createEntriesFile(macro_file);                      /* .ent file creation. */
+            createObjectFile(&context, macro_file, IC, DC);    /* .ob file creation. */
+            createExternFile(&context, macro_file, singlePass ? NULL : &instructions, singlePass ? &fixups : NULL); /* .ext file creation. */
+            createEntriesFile(&context, macro_file);           /* .ent file creation. */
             printf("Outputs were created for file %s.\n", macro_file);
         }
         else
@@ -96,14 +133,16 @@ int main(int argc, char *argv[])
             printf("Number of Errors: %d found in %s.\n", errorsCount, macro_file);
         }
 
-        clearData(linesArr, linesCount, IC + DC); /* Clear the data and reset global variables. */
-        fclose(file);
+        resetContext(&context); /* Release the labels, the entries and the file names for the next file. */
 
         /* Freeing the allocated memory. */
-        free(source_file);
-        free(macro_file);
+        freeTextBuffer(&program);
     }
-    
+
+    freeContext(&context);
+    freeArena(&library.memory);
+    freeArena(&symbolsMemory);
+
     printf("Finished\n\n");
     return 0;
 }
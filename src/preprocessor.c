@@ -5,199 +5,1176 @@
 #include "helpers.h"
 #include "preprocessor.h"
 
+/* Names of the conditional directives, by their ConditionalKind. */
+const char *g_conditionalNames[] = { NULL, ".ifdef", ".ifndef", ".else", ".endif" };
 
-void replaceMacroReferences(char *input_file, MacroNode *head)
+int replaceMacroReferences(textBuffer *source, lineMap *lines, macroMatcher *matcher, textBuffer *output, char *file_name)
 {
-    FILE *fp_in = fopen(input_file, "r");          /* Open the input file for reading. */
-    FILE *fp_out = fopen("temp_output_file", "w"); /* Open a temporary file for writing. */
-    char str[LINE_MAX_LENGTH];
-    char *modified_str;
-    char *token;
-    MacroNode *current;
+    char *cursor = source->data; /* Reading position in the source text. */
+    int i = 0;
 
-    if (!fp_in || !fp_out)
+    while (*cursor)
     {
-        logAndExitOnInternalError("ERROR: Failed to open file");
-        if (fp_in) fclose(fp_in);
-        if (fp_out) fclose(fp_out);
-        return;
+        cursor = expandMacroReferences(cursor, matcher, output, file_name, (i < lines->count) ? lines->lines[i++] : 0); /* Add the line to the output text, with its macros replaced. */
+        if (!cursor)
+        {
+            return 0;
+        }
     }
+    return 1;
+}
 
-    while (fgets(str, LINE_MAX_LENGTH, fp_in))
+int processMacros(char *file_name, char *macro_file_name, macroTable *symbols, macroLibrary *library, textBuffer *output, memoryArena *memory)
+{
+    macroTable table;
+    macroMatcher matcher;
+    textBuffer source; /* The source without extra white spaces and macro definitions. */
+    lineMap lines;     /* The line in the file of every line of the source, for errors. */
+
+    initTextBuffer(&source);
+    initMacroTable(&table, memory); /* The macros are released with the arena of the file. */
+    initLineMap(&lines, memory);
+    if (!importMacros(file_name, symbols, library, &table, &source, &lines))
     {
-        char *original_str = stringDuplicate(str); /* Duplicate the original string. */
+        freeTextBuffer(&source);
+        return 0;
+    }
 
-        token = strtok(str, " \n");
+    if (library && table.count == 0) /* The automaton of the library can be used as is. */
+    {
+        matcher = library->matcher;
+    }
+    else
+    {
+        buildMacroMatcher(&matcher, library ? &library->table : NULL, &table, memory);
+        if (!resolveMacros(&table, &matcher, file_name)) /* Expand the macros that call other macros, once. */
+        {
+            freeTextBuffer(&source);
+            return 0;
+        }
+    }
+    if (!replaceMacroReferences(&source, &lines, &matcher, output, file_name)) /* Process macro calls in the text. */
+    {
+        freeTextBuffer(&source);
+        return 0;
+    }
+    freeTextBuffer(&source);
+
+    if (!macro_file_name) /* The .am file wasn't requested. */
+    {
+        printf("Macro execution completed for file: %s\n", file_name);
+        return 1;
+    }
+
+    if (!writeTextBufferToFile(macro_file_name, output))
+    {
+        logAndExitOnInternalError("Failed to write processed text to new file");
+        return 0;
+    }
 
-        if (token && strcmp(token, "macr") == 0) /* Check for macro declaration. */
+    printf("Macro execution completed, output file: %s\n", macro_file_name);
+    return 1;
+}
+
+int isMacroDelimiter(char c)
+{
+    return (c == ' ' || c == '\t' || c == ',' || c == '\n' || c == '\0'); /* Chars that can't be a part of a macro name. */
+}
+
+void buildMacroMatcher(macroMatcher *matcher, macroTable *library, macroTable *table, memoryArena *memory)
+{
+    int max_states = 1, states = 1, state, cls, i, t;
+    macroTable *tables[2];
+    MacroNode *node;
+    char *c;
+
+    tables[0] = library; /* The macros of the file come last, so they replace library macros with the same name. */
+    tables[1] = table;
+
+    memset(matcher->charClass, 0, sizeof(matcher->charClass));
+    matcher->numClasses = 1;
+    for (t = 0; t < 2; t++) /* Give a column to every char that is used in a name. */
+    {
+        for (i = 0; tables[t] && i < tables[t]->size; i++)
+        {
+            for (node = tables[t]->buckets[i]; node; node = node->next)
+            {
+                for (c = node->name; *c; c++)
+                {
+                    if (!matcher->charClass[(unsigned char)*c])
+                    {
+                        matcher->charClass[(unsigned char)*c] = matcher->numClasses++;
+                    }
+                }
+                max_states += strlen(node->name);
+            }
+        }
+    }
+    matcher->transitions = (int *)arenaAllocateZeroed(memory, (size_t)max_states * matcher->numClasses * sizeof(int));
+    matcher->accept = (MacroNode **)arenaAllocateZeroed(memory, max_states * sizeof(MacroNode *));
+    matcher->memory = memory;
+
+    for (t = 0; t < 2; t++) /* Add the path of every name, starting at the root state (0). */
+    {
+        for (i = 0; tables[t] && i < tables[t]->size; i++)
         {
-            while (fgets(str, LINE_MAX_LENGTH, fp_in))
+            for (node = tables[t]->buckets[i]; node; node = node->next)
             {
-                token = strtok(str, " \n");
-                if (token && strcmp(token, "endmacr") == 0)
+                state = 0;
+                for (c = node->name; *c; c++)
                 {
-                    break; /* Skip lines until the end of macro declaration. */
+                    cls = matcher->charClass[(unsigned char)*c];
+                    if (!matcher->transitions[state * matcher->numClasses + cls])
+                    {
+                        matcher->transitions[state * matcher->numClasses + cls] = states++;
+                    }
+                    state = matcher->transitions[state * matcher->numClasses + cls];
                 }
+                matcher->accept[state] = node;
+            }
+        }
+    }
+}
+
+MacroNode *matchMacroToken(macroMatcher *matcher, char *token, char **end)
+{
+    int state = 0, cls;
+
+    while (!isMacroDelimiter(*token) && *token != '"')
+    {
+        if (state != -1) /* Follow the token in the automaton until it leaves every name. */
+        {
+            cls = matcher->charClass[(unsigned char)*token];
+            state = cls ? matcher->transitions[state * matcher->numClasses + cls] : 0;
+            if (!state)
+            {
+                state = -1;
+            }
+        }
+        token++;
+    }
+
+    *end = token;
+    return (state > 0) ? matcher->accept[state] : NULL; /* A match only if the whole token is a name. */
+}
+
+char *expandMacroReferences(char *str, macroMatcher *matcher, textBuffer *output, char *file_name, int lineNum)
+{
+    char *copied = str; /* Start of the text that wasn't added to the output yet. */
+    char *start = str, *end;
+    char *args[MACRO_PARAMS_MAX];
+    size_t lengths[MACRO_PARAMS_MAX];
+    MacroNode *macro;
+
+    while (*start && *start != '\n')
+    {
+        if (*start == '"') /* Strings can't contain macro references. */
+        {
+            start++;
+            while (*start && *start != '\n' && *start != '"')
+            {
+                start++;
             }
+            if (*start == '"')
+            {
+                start++;
+            }
+            continue;
+        }
+        if (isMacroDelimiter(*start))
+        {
+            start++;
             continue;
         }
 
-        current = head;
-        while (current != NULL)
+        macro = matchMacroToken(matcher, start, &end);
+        if (macro && macro->state != MACRO_EXPANDED && !resolveMacro(macro, matcher, file_name)) /* A call inside a macro. */
         {
-            modified_str = substitutePlaceholder(original_str, current); /* Replace macros in the line. */
-            if (modified_str)
+            return NULL;
+        }
+        if (macro) /* Replace the token, and the arguments after it, with the macro content. */
+        {
+            if (macro->numParams && readMacroArguments(end, args, lengths, &end) != macro->numParams)
             {
-                strcpy(original_str, modified_str);
-                free(modified_str);
+                printf("ERROR: Line %d in file \"%s\": macro \"%s\" expects %d arguments.\n", lineNum, file_name, macro->name, macro->numParams);
+                return NULL;
             }
-            current = current->next;
+            appendCharsToTextBuffer(output, copied, start - copied);
+            appendMacroExpansion(output, macro, args, lengths);
+            copied = end;
         }
-        fprintf(fp_out, "%s", original_str); /* Write the modified line to the temporary file.*/
-        free(original_str);
+        start = end;
     }
 
-    fclose(fp_in);  /* Close the input file. */
-    fclose(fp_out); /* Close the temporary file. */
+    if (*start == '\n')
+    {
+        start++;
+    }
+    appendCharsToTextBuffer(output, copied, start - copied); /* Add the rest of the line. */
+    return start;
+}
+
+char *matchLineKeyword(char *str, const char *keyword)
+{
+    size_t length = strlen(keyword);
 
-    remove(input_file);                     /* Remove the original input file. */
-    rename("temp_output_file", input_file); /* Rename the temporary file to the original input file. */
+    if (strncmp(str, keyword, length) == 0 && (str[length] == ' ' || str[length] == '\n' || str[length] == '\0'))
+    {
+        return str + length; /* The keyword is the first word of the line. */
+    }
+    return NULL;
 }
 
-int processMacros(char *file_name)
+int analyzeMacroDefinition(char *str, char **name, char **params, int line_count, char *file_name, memoryArena *memory)
 {
-    MacroNode *head = NULL;
-    char *new_file_name = addNewFile(file_name, ".am"); /* Create the new .am file name. */
+    char *param, *other;
+    size_t length;
+    int count = 0;
 
-    if (!importMacros(file_name, &head))
+    while (*str == ' ')
+    {
+        str++;
+    }
+    length = strcspn(str, " \n"); /* The name ends at the next space or at the end of the line. */
+    if (!length)
     {
-        free(new_file_name);
+        logAndExitOnInternalError("ERROR:  Word cant be found in macro");
         return 0;
     }
+    *name = arenaAllocate(memory, length + 1);
+    memcpy(*name, str, length);
+    (*name)[length] = '\0';
 
-    replaceMacroReferences(file_name, head); /* Process macro calls in the file. */
+    str += length;
+    while (*str == ' ')
+    {
+        str++;
+    }
+    length = strcspn(str, "\n"); /* The rest of the line is the list of the parameters. */
+    *params = arenaAllocate(memory, length + 1);
+    memcpy(*params, str, length);
+    (*params)[length] = '\0';
 
-    if (!copyFile(new_file_name, file_name))
+    for (param = *params; *param; param += length + (param[length] == ','))
     {
-        logAndExitOnInternalError("Failed to copy processed file to new file");
-        freeList(head);
-        free(new_file_name);
+        length = strcspn(param, ",");
+        for (other = *params; other < param; other += strcspn(other, ",") + 1) /* Parameter names can't repeat. */
+        {
+            if (strcspn(other, ",") == length && strncmp(other, param, length) == 0)
+            {
+                break;
+            }
+        }
+        if (++count > MACRO_PARAMS_MAX || !isalpha((unsigned char)*param) || macroTokenLength(param) != length
+            || other < param || (param[length] == ',' && !param[length + 1]))
+        {
+            printf("ERROR: Line %d in file \"%s\": wrong macro parameters.\n", line_count, file_name);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+char *allocateMemory(size_t size)
+{
+    char *ptr = (char *)malloc(size);
+    if (!ptr)
+    {
+        logAndExitOnInternalError("ERROR: Allocation of memory failed");
+    }
+    return ptr;
+}
+
+int importMacros(char *file_name, macroTable *symbols, macroLibrary *library, macroTable *table, textBuffer *source, lineMap *lines)
+{
+    int line_count = 0, macro_line = 0, status;
+    boolean failed = FALSE;
+    char str[LINE_MAX_LENGTH + 2]; /* +2 for \n and \0 */
+    char *name = NULL, *params = NULL, *args;
+    textBuffer body; /* Content of the macro that is being read. */
+    conditionalStack conditionals;
+    ConditionalKind kind;
+    MacroNode *node;
+    FILE *fp = fopen(file_name, "r");
+
+    if (!fp)
+    {
+        printf("ERROR: Failed to open the source file \"%s\" for reading.\n", file_name);
         return 0;
     }
 
-    freeList(head);
-    printf("Macro execution completed, output file: %s\n", new_file_name);
-    free(new_file_name);
+    initTextBuffer(&body);
+    conditionals.depth = 0;
+    while ((status = readNormalizedLine(fp, str, ++line_count, file_name)) == 1)
+    {
+        if ((kind = matchConditional(str, &args)) != COND_NONE) /* Conditionals apply inside macro definitions too. */
+        {
+            if (!processConditional(fp, kind, args, &conditionals, &line_count, file_name, symbols, library, table))
+            {
+                failed = TRUE;
+                break;
+            }
+        }
+        else if (name) /* Inside a macro definition. */
+        {
+            if (matchLineKeyword(str, "endmacr"))
+            {
+                node = addMacro(table, name, body.data, macro_line);
+                node->params = params;
+                node->state = MACRO_RAW; /* The template is built when the calls in the content are expanded. */
+                name = NULL;
+            }
+            else
+            {
+                appendToTextBuffer(&body, str);
+            }
+        }
+        else if ((args = matchLineKeyword(str, "macr")) != NULL) /* Check for macro declaration. */
+        {
+            if (!analyzeMacroDefinition(args, &name, &params, line_count, file_name, table->memory))
+            {
+                failed = TRUE;
+                break;
+            }
+            macro_line = line_count;
+            clearTextBuffer(&body);
+        }
+        else
+        {
+            appendToTextBuffer(source, str);
+            if (lines)
+            {
+                addLineToMap(lines, line_count);
+            }
+        }
+    }
+
+    fclose(fp);
+    freeTextBuffer(&body);
+    if (status == -1 || failed) /* A line was too long, the macro name is missing or a conditional is wrong. */
+    {
+        return 0;
+    }
+    if (conditionals.depth)
+    {
+        printf("ERROR: Line %d in file \"%s\": missing .endif.\n", conditionals.line[conditionals.depth - 1], file_name);
+        return 0;
+    }
+    if (name)
+    {
+        logAndExitOnInternalError("ERROR: Cant find macro ending");
+        return 0;
+    }
     return 1;
 }
 
-char *substitutePlaceholder(char *str, MacroNode *macr)
+void writeLibraryNumber(FILE *fp, unsigned long number)
 {
-    char *pos = strstr(str, macr->name);
-    size_t new_len;  /* New length of the string */
-    char *new_str;   /* New string after substitution */
+    int i;
 
-    if (!pos)        /* If macro name not found, return NULL */
+    for (i = 0; i < MACRO_LIBRARY_NUMBER_SIZE; i++) /* Least significant byte first. */
     {
-        return NULL;
+        fputc((int)((number >> (BYTE_LENGTH * i)) & 0xFF), fp);
     }
+}
 
-    new_len = strlen(str) + strlen(macr->content) - strlen(macr->name) + 1;  /* Calculate new length */
-    new_str = allocateMemory(new_len);                                       /* Allocate memory for new string */
-    strncpy(new_str, str, pos - str);                                        /* Copy part before macro name */
-    new_str[pos - str] = '\0';                                               /* Null-terminate the copied part */
-    strcat(new_str, macr->content);                                          /* Concatenate macro content */
-    strcat(new_str, pos + strlen(macr->name));                               /* Concatenate part after macro name */
+unsigned long readLibraryNumber(const unsigned char *bytes)
+{
+    unsigned long number = 0;
+    int i;
 
-    return new_str;
+    for (i = MACRO_LIBRARY_NUMBER_SIZE - 1; i >= 0; i--)
+    {
+        number = (number << BYTE_LENGTH) | bytes[i];
+    }
+    return number;
 }
 
-char *extractMacroData(FILE *fp, fpos_t *pos, int *line_count)
+int compileMacroLibrary(char *file_name, char *library_file_name, macroTable *symbols, memoryArena *memory)
 {
-    char str[LINE_MAX_LENGTH];
-    int macro_length = 0;
-    char *macro;
+    macroTable table;
+    macroMatcher matcher;
+    textBuffer source;
+    MacroNode *node;
+    unsigned long pool_size = 0, offset = 0, segments = 0;
+    int i, j, failed;
+    FILE *fp;
 
-    fsetpos(fp, pos);
-    while (fgets(str, LINE_MAX_LENGTH, fp) && strcmp(str, "endmacr\n") != 0)
+    initTextBuffer(&source);
+    initMacroTable(&table, memory);
+    failed = !importMacros(file_name, symbols, NULL, &table, &source, NULL);
+    freeTextBuffer(&source); /* Only the macro definitions are kept in a library. */
+    if (failed)
     {
-        (*line_count)++;             /* Increment line count for each line read. */
-        macro_length += strlen(str); /* Calculate total length of the macro. */
+        return 0;
+    }
+    buildMacroMatcher(&matcher, NULL, &table, memory);
+    if (!resolveMacros(&table, &matcher, file_name)) /* The library keeps the expanded macros. */
+    {
+        return 0;
     }
-    fsetpos(fp, pos);
 
-    if (feof(fp))
+    fp = fopen(library_file_name, "wb");
+    if (!fp)
     {
-        logAndExitOnInternalError("ERROR: Cant find macro ending");
-        return NULL;
+        printf("ERROR: Failed to open the library file \"%s\" for writing.\n", library_file_name);
+        return 0;
     }
 
-    macro = allocateMemory(macro_length + 1);
-    macro[0] = '\0';
-    while (fgets(str, LINE_MAX_LENGTH, fp) && strcmp(str, "endmacr\n") != 0)
+    for (i = 0; i < table.size; i++) /* The names and contents are stored one after the other. */
+    {
+        for (node = table.buckets[i]; node; node = node->next)
+        {
+            pool_size += strlen(node->name) + strlen(node->content) + 2;
+        }
+    }
+
+    fwrite(MACRO_LIBRARY_MAGIC, 1, strlen(MACRO_LIBRARY_MAGIC), fp);
+    writeLibraryNumber(fp, (unsigned long)table.count);
+    for (i = 0; i < table.size; i++)
+    {
+        for (node = table.buckets[i]; node; node = node->next)
+        {
+            segments += node->numSegments;
+        }
+    }
+    writeLibraryNumber(fp, segments);
+    writeLibraryNumber(fp, pool_size);
+    segments = 0;
+    for (i = 0; i < table.size; i++) /* The name table: offsets of the name and the content, the line and the template. */
+    {
+        for (node = table.buckets[i]; node; node = node->next)
+        {
+            writeLibraryNumber(fp, offset);
+            offset += strlen(node->name) + 1;
+            writeLibraryNumber(fp, offset);
+            offset += strlen(node->content) + 1;
+            writeLibraryNumber(fp, (unsigned long)node->line);
+            writeLibraryNumber(fp, (unsigned long)node->numParams);
+            writeLibraryNumber(fp, segments);
+            writeLibraryNumber(fp, (unsigned long)node->numSegments);
+            segments += node->numSegments;
+        }
+    }
+    offset = 0;
+    for (i = 0; i < table.size; i++) /* The templates: offset and length of the text of every segment, and its parameter. */
     {
-        strcat(macro, str);
+        for (node = table.buckets[i]; node; node = node->next)
+        {
+            offset += strlen(node->name) + 1;
+            for (j = 0; j < node->numSegments; j++)
+            {
+                writeLibraryNumber(fp, offset + (unsigned long)(node->segments[j].text - node->content));
+                writeLibraryNumber(fp, (unsigned long)node->segments[j].length);
+                writeLibraryNumber(fp, (unsigned long)(node->segments[j].param + 1));
+            }
+            offset += strlen(node->content) + 1;
+        }
     }
-    return macro;
+    for (i = 0; i < table.size; i++) /* The strings, with their null terminators. */
+    {
+        for (node = table.buckets[i]; node; node = node->next)
+        {
+            fwrite(node->name, 1, strlen(node->name) + 1, fp);
+            fwrite(node->content, 1, strlen(node->content) + 1, fp);
+        }
+    }
+
+    failed = ferror(fp);
+    if (fclose(fp) != 0 || failed)
+    {
+        printf("ERROR: Failed to write the library file \"%s\".\n", library_file_name);
+        return 0;
+    }
+
+    printf("Macro library compiled, output file: %s\n", library_file_name);
+    return 1;
 }
 
-int analyzeMacroDefinition(char *str, char **name, int line_count, char *file_name)
+int loadMacroLibrary(char *library_file_name, macroLibrary *library)
 {
-    char *temp_name = strtok(NULL, " \n");
-    if (!temp_name)
+    size_t header_size = strlen(MACRO_LIBRARY_MAGIC) + 3 * MACRO_LIBRARY_NUMBER_SIZE;
+    size_t entry_size = 6 * MACRO_LIBRARY_NUMBER_SIZE, segment_size = 3 * MACRO_LIBRARY_NUMBER_SIZE;
+    unsigned long count, segments_count, pool_size, name_offset, content_offset, first, text_offset, i, j;
+    unsigned char *image, *entry, *segment;
+    MacroNode *nodes;
+    macroSegment *segments;
+    char *pool;
+    long size;
+    FILE *fp = fopen(library_file_name, "rb");
+
+    if (!fp)
     {
-        logAndExitOnInternalError("ERROR:  Word cant be found in macro");
+        printf("ERROR: Failed to open the library file \"%s\" for reading.\n", library_file_name);
+        return 0;
+    }
+
+    freeArena(&library->memory); /* A library that was loaded before is replaced. */
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    image = (unsigned char *)arenaAllocate(&library->memory, size > 0 ? (size_t)size : 1);
+    if (size < 0 || fread(image, 1, (size_t)size, fp) != (size_t)size)
+    {
+        fclose(fp);
+        printf("ERROR: Failed to read the library file \"%s\".\n", library_file_name);
         return 0;
     }
-    *name = allocateMemory(strlen(temp_name) + 1);
-    strcpy(*name, temp_name);
+    fclose(fp);
+
+    if ((size_t)size < header_size || memcmp(image, MACRO_LIBRARY_MAGIC, strlen(MACRO_LIBRARY_MAGIC)) != 0)
+    {
+        printf("ERROR: \"%s\" is not a macro library.\n", library_file_name);
+        return 0;
+    }
+    count = readLibraryNumber(image + strlen(MACRO_LIBRARY_MAGIC));
+    segments_count = readLibraryNumber(image + strlen(MACRO_LIBRARY_MAGIC) + MACRO_LIBRARY_NUMBER_SIZE);
+    pool_size = readLibraryNumber(image + strlen(MACRO_LIBRARY_MAGIC) + 2 * MACRO_LIBRARY_NUMBER_SIZE);
+    if (count > ((size_t)size - header_size) / entry_size
+        || segments_count > ((size_t)size - header_size - count * entry_size) / segment_size
+        || header_size + count * entry_size + segments_count * segment_size + pool_size != (size_t)size
+        || (pool_size && image[size - 1] != '\0'))
+    {
+        printf("ERROR: The macro library \"%s\" is damaged.\n", library_file_name);
+        return 0;
+    }
+
+    pool = (char *)image + header_size + count * entry_size + segments_count * segment_size; /* The strings are used in place. */
+    nodes = (MacroNode *)arenaAllocate(&library->memory, (count ? count : 1) * sizeof(MacroNode));
+    segments = (macroSegment *)arenaAllocate(&library->memory, (segments_count ? segments_count : 1) * sizeof(macroSegment));
+    for (j = 0, segment = image + header_size + count * entry_size; j < segments_count; j++, segment += segment_size)
+    {
+        text_offset = readLibraryNumber(segment);
+        segments[j].text = pool + text_offset;
+        segments[j].length = (int)readLibraryNumber(segment + MACRO_LIBRARY_NUMBER_SIZE);
+        segments[j].param = (int)readLibraryNumber(segment + 2 * MACRO_LIBRARY_NUMBER_SIZE) - 1;
+        if (text_offset + segments[j].length > pool_size || segments[j].length < 0 || segments[j].param >= MACRO_PARAMS_MAX)
+        {
+            printf("ERROR: The macro library \"%s\" is damaged.\n", library_file_name);
+            return 0;
+        }
+    }
+    initMacroTable(&library->table, &library->memory);
+    for (i = 0, entry = image + header_size; i < count; i++, entry += entry_size)
+    {
+        name_offset = readLibraryNumber(entry);
+        content_offset = readLibraryNumber(entry + MACRO_LIBRARY_NUMBER_SIZE);
+        if (name_offset >= pool_size || content_offset >= pool_size || !pool[name_offset]
+            || findMacro(&library->table, pool + name_offset, strlen(pool + name_offset)))
+        {
+            printf("ERROR: The macro library \"%s\" is damaged.\n", library_file_name);
+            return 0;
+        }
+        nodes[i].name = pool + name_offset;
+        nodes[i].content = pool + content_offset;
+        nodes[i].line = (int)readLibraryNumber(entry + 2 * MACRO_LIBRARY_NUMBER_SIZE);
+        nodes[i].params = NULL;
+        nodes[i].state = MACRO_EXPANDED;
+        nodes[i].numParams = (int)readLibraryNumber(entry + 3 * MACRO_LIBRARY_NUMBER_SIZE);
+        first = readLibraryNumber(entry + 4 * MACRO_LIBRARY_NUMBER_SIZE);
+        nodes[i].numSegments = (int)readLibraryNumber(entry + 5 * MACRO_LIBRARY_NUMBER_SIZE);
+        nodes[i].segments = segments + first;
+        nodes[i].calling = NULL;
+        if (nodes[i].numParams > MACRO_PARAMS_MAX || first > segments_count || nodes[i].numSegments < 0
+            || (unsigned long)nodes[i].numSegments > segments_count - first)
+        {
+            printf("ERROR: The macro library \"%s\" is damaged.\n", library_file_name);
+            return 0;
+        }
+        for (j = 0; j < (unsigned long)nodes[i].numSegments; j++)
+        {
+            if (nodes[i].segments[j].param >= nodes[i].numParams)
+            {
+                printf("ERROR: The macro library \"%s\" is damaged.\n", library_file_name);
+                return 0;
+            }
+        }
+        insertMacroNode(&library->table, &nodes[i]);
+    }
+
+    buildMacroMatcher(&library->matcher, NULL, &library->table, &library->memory);
+    printf("Macro library loaded: %s\n", library_file_name);
     return 1;
 }
 
-char *allocateMemory(size_t size)
+ConditionalKind matchConditional(char *str, char **args)
 {
-    char *ptr = (char *)malloc(size);
-    if (!ptr)
+    size_t length;
+    int kind;
+
+    while (*str == ' ' || *str == '\t')
     {
-        logAndExitOnInternalError("ERROR: Allocation of memory failed");
+        str++;
     }
-    return ptr;
+    if (*str != '.') /* Most lines are rejected by their first char. */
+    {
+        return COND_NONE;
+    }
+
+    for (kind = COND_IFDEF; kind <= COND_ENDIF; kind++)
+    {
+        length = strlen(g_conditionalNames[kind]);
+        if (strncmp(str, g_conditionalNames[kind], length) == 0 && (str[length] == '\0' || isspace((unsigned char)str[length])))
+        {
+            *args = str + length;
+            return (ConditionalKind)kind;
+        }
+    }
+    return COND_NONE;
 }
 
-int importMacros(char *file_name, MacroNode **head)
+int isSymbolDefined(char *name, size_t length, macroTable *symbols, macroLibrary *library, macroTable *table)
 {
-    int line_count = 0;
-    char str[LINE_MAX_LENGTH];
-    char *name, *content;
-    fpos_t pos;
-    FILE *fp = fopen(file_name, "r");
+    return (symbols && findMacro(symbols, name, length))
+        || (library && findMacro(&library->table, name, length))
+        || findMacro(table, name, length);
+}
 
-    if (!fp)
+ConditionalKind skipDisabledLines(FILE *fp, int *line_count)
+{
+    char str[LINE_MAX_LENGTH + 2];
+    char *args;
+    boolean line_start = TRUE;
+    ConditionalKind kind;
+    size_t length;
+    int depth = 0; /* Blocks that were opened inside the disabled lines. */
+
+    while (fgets(str, sizeof(str), fp))
+    {
+        length = strlen(str);
+        if (line_start)
+        {
+            (*line_count)++;
+            kind = matchConditional(str, &args);
+            if (kind == COND_IFDEF || kind == COND_IFNDEF)
+            {
+                depth++;
+            }
+            else if ((kind == COND_ELSE || kind == COND_ENDIF) && !depth)
+            {
+                return kind; /* The end of the disabled lines. */
+            }
+            else if (kind == COND_ENDIF)
+            {
+                depth--;
+            }
+        }
+        line_start = (length && str[length - 1] == '\n'); /* The rest of a long line is skipped in pieces. */
+    }
+    return COND_NONE;
+}
+
+int processConditional(FILE *fp, ConditionalKind kind, char *args, conditionalStack *conditionals, int *line_count,
+                       char *file_name, macroTable *symbols, macroLibrary *library, macroTable *table)
+{
+    size_t length;
+    boolean enabled;
+    int line = *line_count;
+
+    while (*args == ' ')
+    {
+        args++;
+    }
+    length = strcspn(args, " \n");
+
+    if (kind == COND_IFDEF || kind == COND_IFNDEF)
+    {
+        if (!length || args[length + strspn(args + length, " \n")] != '\0')
+        {
+            printf("ERROR: Line %d in file \"%s\": expected a single symbol name.\n", line, file_name);
+            return 0;
+        }
+        if (conditionals->depth == CONDITIONAL_MAX_DEPTH)
+        {
+            printf("ERROR: Line %d in file \"%s\": too many nested conditionals.\n", line, file_name);
+            return 0;
+        }
+        conditionals->line[conditionals->depth] = line;
+        conditionals->elseSeen[conditionals->depth] = FALSE;
+        conditionals->depth++;
+
+        enabled = isSymbolDefined(args, length, symbols, library, table);
+        if (kind == COND_IFNDEF)
+        {
+            enabled = !enabled;
+        }
+        if (enabled)
+        {
+            return 1;
+        }
+    }
+    else
     {
-        logAndExitOnInternalError("ERROR: Failed to open file");
+        if (length)
+        {
+            printf("ERROR: Line %d in file \"%s\": unexpected text after the directive.\n", line, file_name);
+            return 0;
+        }
+        if (!conditionals->depth)
+        {
+            printf("ERROR: Line %d in file \"%s\": %s without .ifdef or .ifndef.\n", line, file_name, g_conditionalNames[kind]);
+            return 0;
+        }
+        if (kind == COND_ENDIF)
+        {
+            conditionals->depth--;
+            return 1;
+        }
+        if (conditionals->elseSeen[conditionals->depth - 1])
+        {
+            printf("ERROR: Line %d in file \"%s\": more than one .else.\n", line, file_name);
+            return 0;
+        }
+    }
+
+    /* The lines up to the .else or the .endif of the block are disabled. */
+    conditionals->elseSeen[conditionals->depth - 1] = (kind == COND_ELSE);
+    kind = skipDisabledLines(fp, line_count);
+    if (kind == COND_ENDIF)
+    {
+        conditionals->depth--;
+        return 1;
+    }
+    if (kind == COND_NONE)
+    {
+        printf("ERROR: Line %d in file \"%s\": missing .endif.\n", conditionals->line[conditionals->depth - 1], file_name);
+        return 0;
+    }
+    if (conditionals->elseSeen[conditionals->depth - 1])
+    {
+        printf("ERROR: Line %d in file \"%s\": more than one .else.\n", *line_count, file_name);
         return 0;
     }
+    conditionals->elseSeen[conditionals->depth - 1] = TRUE; /* The lines after the .else are enabled. */
+    return 1;
+}
+
+size_t macroTokenLength(char *str)
+{
+    size_t length = 0;
+
+    while (isalnum((unsigned char)str[length]) || str[length] == '_')
+    {
+        length++;
+    }
+    return length;
+}
+
+void initTemplateBuilder(templateBuilder *builder, char *params, memoryArena *memory)
+{
+    size_t length;
+
+    for (builder->numParams = 0; *params; params += length + (params[length] == ','))
+    {
+        length = strcspn(params, ",");
+        builder->names[builder->numParams] = params;
+        builder->lengths[builder->numParams++] = length;
+    }
+    initTextBuffer(&builder->text);
+    builder->segments = NULL;
+    builder->numSegments = 0;
+    builder->capacity = 0;
+    builder->segmentStart = 0;
+    builder->memory = memory;
+}
+
+void endTemplateSegment(templateBuilder *builder, int param)
+{
+    macroSegment *old = builder->segments;
 
-    while (fgets(str, LINE_MAX_LENGTH, fp))
+    if (builder->numSegments >= builder->capacity) /* The old array is released with the arena. */
     {
-        line_count++;
-        if (strcmp(strtok(str, " "), "macr") == 0)
+        builder->capacity = builder->capacity ? builder->capacity * 2 : MACRO_SEGMENTS_INITIAL_SIZE;
+        builder->segments = (macroSegment *)arenaAllocate(builder->memory, builder->capacity * sizeof(macroSegment));
+        if (builder->numSegments)
+        {
+            memcpy(builder->segments, old, builder->numSegments * sizeof(macroSegment));
+        }
+    }
+    builder->segments[builder->numSegments].text = NULL;
+    builder->segments[builder->numSegments].length = (int)(builder->text.length - builder->segmentStart);
+    builder->segments[builder->numSegments++].param = param;
+    builder->segmentStart = builder->text.length;
+}
+
+void appendTemplateText(templateBuilder *builder, char *str, size_t length)
+{
+    char *c = str, *text = str, *stop = str + length; /* text is the start of the chars that weren't added yet. */
+    size_t tokenLength;
+    int i;
+
+    while (builder->numParams && c < stop)
+    {
+        if (*c == '"') /* Parameters aren't replaced in strings. */
+        {
+            c += strcspn(c + 1, "\"\n") + 1;
+            c += (*c == '"');
+            continue;
+        }
+        tokenLength = macroTokenLength(c);
+        if (!tokenLength)
         {
-            if (!analyzeMacroDefinition(str, &name, line_count, file_name))
+            c++;
+            continue;
+        }
+        if (tokenLength > (size_t)(stop - c))
+        {
+            tokenLength = stop - c;
+        }
+        for (i = 0; i < builder->numParams; i++)
+        {
+            if (builder->lengths[i] == tokenLength && strncmp(builder->names[i], c, tokenLength) == 0) /* End the segment at the parameter. */
             {
-                fclose(fp);
-                return 0;
+                appendCharsToTextBuffer(&builder->text, text, c - text);
+                endTemplateSegment(builder, i);
+                text = c + tokenLength;
+                break;
             }
-            fgetpos(fp, &pos);
-            content = extractMacroData(fp, &pos, &line_count);
-            if (!content)
+        }
+        c += tokenLength;
+    }
+    if (text < stop)
+    {
+        appendCharsToTextBuffer(&builder->text, text, stop - text);
+    }
+}
+
+void finishTemplate(templateBuilder *builder, MacroNode *macro)
+{
+    int i;
+    size_t offset = 0;
+
+    endTemplateSegment(builder, -1); /* The text after the last parameter. */
+    macro->content = arenaStringDuplicate(builder->memory, builder->text.data);
+    for (i = 0; i < builder->numSegments; i++) /* The segments follow each other in the content. */
+    {
+        builder->segments[i].text = macro->content + offset;
+        offset += builder->segments[i].length;
+    }
+    macro->segments = builder->segments;
+    macro->numSegments = builder->numSegments;
+    macro->numParams = builder->numParams;
+    freeTextBuffer(&builder->text);
+}
+
+void printMacroCycle(MacroNode *macro, char *file_name)
+{
+    MacroNode *node = macro;
+
+    printf("ERROR: Line %d in file \"%s\": macro \"%s\" calls itself: %s", macro->line, file_name, macro->name, macro->name);
+    do /* Follow the calls that are being expanded until the macro is reached again. */
+    {
+        node = node->calling;
+        printf(" -> %s", node->name);
+    } while (node != macro);
+    printf(".\n");
+}
+
+int resolveMacro(MacroNode *macro, macroMatcher *matcher, char *file_name)
+{
+    templateBuilder builder;
+    char *cursor = macro->content, *copied = macro->content, *end; /* copied is the start of the content that wasn't added yet. */
+    char *args[MACRO_PARAMS_MAX];
+    size_t lengths[MACRO_PARAMS_MAX];
+    MacroNode *callee;
+    int i;
+
+    if (macro->state == MACRO_EXPANDED)
+    {
+        return 1;
+    }
+    if (macro->state == MACRO_EXPANDING) /* The macro is reached again from its own content. */
+    {
+        printMacroCycle(macro, file_name);
+        return 0;
+    }
+
+    macro->state = MACRO_EXPANDING;
+    initTemplateBuilder(&builder, macro->params, matcher->memory); /* The parameters are found in the content before the calls are expanded. */
+    while (*cursor)
+    {
+        if (*cursor == '"') /* Strings can't contain macro calls. */
+        {
+            cursor += strcspn(cursor + 1, "\"\n") + 1;
+            cursor += (*cursor == '"');
+            continue;
+        }
+        if (isMacroDelimiter(*cursor))
+        {
+            cursor++;
+            continue;
+        }
+
+        callee = matchMacroToken(matcher, cursor, &end);
+        if (!callee)
+        {
+            cursor = end;
+            continue;
+        }
+        macro->calling = callee;
+        if (!resolveMacro(callee, matcher, file_name)) /* Expands the called macros first. */
+        {
+            freeTextBuffer(&builder.text);
+            return 0;
+        }
+        if (callee->numParams && readMacroArguments(end, args, lengths, &end) != callee->numParams)
+        {
+            printf("ERROR: Line %d in file \"%s\": macro \"%s\" expects %d arguments, in the definition of macro \"%s\".\n",
+                   macro->line, file_name, callee->name, callee->numParams, macro->name);
+            freeTextBuffer(&builder.text);
+            return 0;
+        }
+
+        appendTemplateText(&builder, copied, cursor - copied);
+        for (i = 0; i < callee->numSegments; i++) /* The called macro is copied as is, only its arguments can use the parameters. */
+        {
+            appendCharsToTextBuffer(&builder.text, callee->segments[i].text, callee->segments[i].length);
+            if (callee->segments[i].param >= 0)
+            {
+                appendTemplateText(&builder, args[callee->segments[i].param], lengths[callee->segments[i].param]);
+            }
+        }
+        copied = cursor = end;
+    }
+    appendTemplateText(&builder, copied, cursor - copied);
+
+    finishTemplate(&builder, macro);
+    macro->calling = NULL;
+    macro->state = MACRO_EXPANDED;
+    return 1;
+}
+
+int resolveMacros(macroTable *table, macroMatcher *matcher, char *file_name)
+{
+    MacroNode *node;
+    int i;
+
+    for (i = 0; i < table->size; i++)
+    {
+        for (node = table->buckets[i]; node; node = node->next)
+        {
+            if (!resolveMacro(node, matcher, file_name))
             {
-                fclose(fp);
                 return 0;
             }
-            addToTheList(head, name, content, line_count);
         }
     }
-    fclose(fp);
     return 1;
 }
+
+int readMacroArguments(char *str, char **args, size_t *lengths, char **end)
+{
+    int count = 0;
+    size_t length;
+
+    while (*str == ' ')
+    {
+        str++;
+    }
+    while (*str && *str != '\n')
+    {
+        length = strcspn(str, ",\n");
+        if (!length || count == MACRO_PARAMS_MAX) /* An empty argument, or too many of them. */
+        {
+            return -1;
+        }
+        args[count] = str;
+        lengths[count++] = length;
+        str += length;
+        if (*str == ',' && (str[1] == '\n' || !str[1]))
+        {
+            return -1;
+        }
+        str += (*str == ',');
+    }
+    *end = str; /* The arguments take the rest of the line. */
+    return count;
+}
+
+void appendMacroExpansion(textBuffer *output, MacroNode *macro, char **args, size_t *lengths)
+{
+    int i;
+
+    for (i = 0; i < macro->numSegments; i++)
+    {
+        appendCharsToTextBuffer(output, macro->segments[i].text, macro->segments[i].length);
+        if (macro->segments[i].param >= 0)
+        {
+            appendCharsToTextBuffer(output, args[macro->segments[i].param], lengths[macro->segments[i].param]);
+        }
+    }
+}
+
+void initLineGenerator(lineGenerator *generator, char *source)
+{
+    generator->cursor = source;
+    generator->lineNum = 0;
+    generator->depth = 0;
+    generator->repeatedLines = 0;
+}
+
+long parseRepeatCount(char *str)
+{
+    long count;
+    char *end;
+
+    while (*str == ' ')
+    {
+        str++;
+    }
+    if (!isdigit((unsigned char)*str))
+    {
+        return -1;
+    }
+    count = strtol(str, &end, BASE_DECIMAL);
+    end += strspn(end, " ");
+    if ((*end != '\n' && *end != '\0') || count > RAM_LIMIT) /* More repetitions can't fit in the memory anyway. */
+    {
+        return -1;
+    }
+    return count;
+}
+
+char *readGeneratorLine(lineGenerator *generator, size_t *length)
+{
+    char *start = generator->cursor;
+
+    *length = strcspn(start, "\n");
+    generator->cursor += start[*length] ? *length + 1 : *length; /* Move to the start of the next line. */
+    generator->lineNum++;
+    return start;
+}
+
+boolean skipRepeatBody(lineGenerator *generator)
+{
+    int depth = 0; /* Blocks that were opened inside the skipped body. */
+    size_t length;
+    char *line;
+
+    while (*generator->cursor)
+    {
+        line = readGeneratorLine(generator, &length);
+        if (matchLineKeyword(line, ".rept"))
+        {
+            depth++;
+        }
+        else if (matchLineKeyword(line, ".endr") && !depth--)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+GeneratorStatus nextSourceLine(lineGenerator *generator, char **lineStr, int *lineNum)
+{
+    repeatFrame *frame;
+    char *line, *args;
+    size_t length;
+    long count;
+
+    INFINITE_LOOP
+    {
+        if (!*generator->cursor)
+        {
+            if (!generator->depth)
+            {
+                return GEN_END;
+            }
+            *lineNum = generator->frames[0].startLine - 1; /* The line of the outermost .rept. */
+            generator->depth = 0;
+            printError(*lineNum, "ERROR: Missing .endr for .rept.");
+            return GEN_ERROR;
+        }
+
+        line = readGeneratorLine(generator, &length);
+        *lineNum = generator->lineNum;
+
+        if (generator->depth && ++generator->repeatedLines > REPEAT_LINES_MAX) /* Nested counts multiply, so the whole block is bounded. */
+        {
+            *lineNum = generator->frames[0].startLine - 1;
+            generator->cursor = generator->frames[0].start;
+            generator->lineNum = *lineNum;
+            generator->depth = 0;
+            skipRepeatBody(generator); /* Continue after the outermost block. */
+            printError(*lineNum, "ERROR: Too many repeated lines, the max is %d.", REPEAT_LINES_MAX);
+            return GEN_ERROR;
+        }
+
+        if ((args = matchLineKeyword(line, ".rept")) != NULL)
+        {
+            count = parseRepeatCount(args);
+            if (count <= 0 || generator->depth == REPEAT_MAX_DEPTH) /* The body isn't read at all. */
+            {
+                if (!skipRepeatBody(generator))
+                {
+                    printError(*lineNum, "ERROR: Missing .endr for .rept.");
+                    return GEN_ERROR;
+                }
+                if (count < 0)
+                {
+                    printError(*lineNum, "ERROR: The count of .rept must be a number between 0 and %d.", RAM_LIMIT);
+                    return GEN_ERROR;
+                }
+                if (count)
+                {
+                    printError(*lineNum, "ERROR: Too many nested .rept blocks, the max is %d.", REPEAT_MAX_DEPTH);
+                    return GEN_ERROR;
+                }
+                continue;
+            }
+            if (!generator->depth)
+            {
+                generator->repeatedLines = 0;
+            }
+            frame = &generator->frames[generator->depth++];
+            frame->start = generator->cursor;
+            frame->startLine = generator->lineNum + 1;
+            frame->remaining = count - 1;
+            continue;
+        }
+
+        if ((args = matchLineKeyword(line, ".endr")) != NULL)
+        {
+            if (*args == ' ' && args[strspn(args, " ")] != '\n' && args[strspn(args, " ")] != '\0')
+            {
+                printError(*lineNum, "ERROR: Unexpected text after .endr.");
+                return GEN_ERROR;
+            }
+            if (!generator->depth)
+            {
+                printError(*lineNum, "ERROR: .endr without .rept.");
+                return GEN_ERROR;
+            }
+            frame = &generator->frames[generator->depth - 1];
+            if (frame->remaining > 0) /* Read the body again. */
+            {
+                frame->remaining--;
+                generator->cursor = frame->start;
+                generator->lineNum = frame->startLine - 1;
+            }
+            else
+            {
+                generator->depth--;
+            }
+            continue;
+        }
+
+        if (length >= LINE_MAX_LENGTH + 1)
+        {
+            return GEN_LONG_LINE;
+        }
+        if (generator->depth) /* The body is read again, so the parser changes a copy of the line, it is only used until the next line. */
+        {
+            memcpy(generator->repeatedLine, line, length);
+            generator->repeatedLine[length] = '\0';
+            *lineStr = generator->repeatedLine;
+        }
+        else /* End the line in place. */
+        {
+            line[length] = '\0';
+            *lineStr = line;
+        }
+        return GEN_LINE;
+    }
+}
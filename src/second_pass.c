@@ -5,38 +5,38 @@
 #include "helpers.h"
 #include "second_pass.h"
 
-void updateDataLabelsAddress(int IC)
+void updateDataLabelsAddress(assemblerContext *context, int IC)
 {
 	int i;
 
-	for (i = 0; i < g_labelCount; i++)
+	for (i = 0; i < context->labels.count; i++)
 	{
-		if (g_labelsArr[i].isData)
+		if (context->labels.labels[i]->isData)
 		{
-			g_labelsArr[i].address += IC; /* Update the address for data labels by adding IC. */
+			context->labels.labels[i]->address += IC; /* Update the address for data labels by adding IC. */
 		}
 	}
 }
 
-int countIllegalEntries()
+int countIllegalEntries(assemblerContext *context)
 {
 	int i, ret = 0;
 	labelInfo *label;
 
-	for (i = 0; i < g_entryLabelsCount; i++)
+	for (i = 0; i < context->entryLabelsCount; i++)
 	{
-		label = getLabel(g_entryLinesArr[i]->lineStr);
-		if (label)
+		label = context->entryLabels[i];
+		if (label->isDefined)
 		{
 			if (label->isExtern)
 			{
-				printError(g_entryLinesArr[i]->lineNum, "The parameter for .entry can't be an external label.");
+				printError(label->entryLineNum, "The parameter for .entry can't be an external label.");
 				ret++; /* Increment the error count for illegal entry labels. */
 			}
 		}
 		else
 		{
-			printError(g_entryLinesArr[i]->lineNum, "No such label as \"%s\".", g_entryLinesArr[i]->lineStr);
+			printError(label->entryLineNum, "No such label as \"%s\".", context->names.names[label->nameId]);
 			ret++; /* Increment the error count for non-existing labels. */
 		}
 	}
@@ -44,217 +44,178 @@ int countIllegalEntries()
 	return ret;
 }
 
-boolean updateLabelOpAddress(operandInfo *op, int lineNum)
+boolean resolveLabelOperand(assemblerContext *context, labelInfo *label, int *value, AREKind *are, int lineNum)
 {
-	if (op->type == OP_LABEL)
+	*are = (AREKind)ARE_ABS;
+	if (label)
 	{
-		labelInfo *label = getLabel(op->str);
-		if (label == NULL)
+		if (!label->isDefined)
 		{
-			if (isLegalLabel(op->str, lineNum, TRUE))
-			{
-				printError(lineNum, "No such label as \"%s\"", op->str);
-			}
+			printError(lineNum, "No such label as \"%s\"", context->names.names[label->nameId]);
 			return FALSE; /* Return false if the label does not exist. */
 		}
-		op->value = label->address; /* Update the operand value with the label address. */
+		*are = label->isExtern ? ARE_EXT : (AREKind)ARE_RELOC; /* Set the ARE type to external if the label is external. */
+		*value = label->address; /* The operand value is the label address. */
 	}
 
 	return TRUE;
 }
 
-int getNumFromMemoryWord(memoryWord memory)
+machineWord getCmdMemoryWord(int opcode, int srcMode, int destMode)
 {
-	unsigned int mask = ~0;
-	mask >>= (sizeof(int) * BYTE_LENGTH - WORD_LENGTH);
-
-	return mask & ((memory.valueBits.value << 3) + memory.are); /* Return the memory word value with the mask applied. */
+	return (machineWord)((opcode << OPCODE_SHIFT) | (srcMode << SRC_MODE_SHIFT) | (destMode << DEST_MODE_SHIFT) | ARE_ABS);
 }
 
-int getOpTypeId(operandInfo op)
+machineWord getOpMemoryWord(int mode, int value, AREKind are, boolean isDest)
 {
-	if (op.type != OP_INVALID)
+	if (mode & OP_REGISTER_MODES) /* The register goes to the destination or the source register bits. */
 	{
-		return (int)op.type; /* Return the operand type ID if it's valid. */
+		return (machineWord)(((value & REG_MASK) << (isDest ? DEST_REG_SHIFT : SRC_REG_SHIFT)) | are);
 	}
 
-	return 0; /* Return 0 for invalid operand type. */
+	return (machineWord)(((value & VALUE_MASK) << ARE_BITS) | are); /* The number or the label address, in two's complement. */
 }
 
-memoryWord getCmdMemoryWord(lineInfo line)
+void addWordToMemory(machineWord *memoryArr, int *memoryCounter, machineWord memory)
 {
-	memoryWord memory = { 0 };
-
-	memory.are = (AREKind)ARE_ABS;
-	memory.valueBits.cmdBits.dest = getOpTypeId(line.op2); /* Set the destination operand type. */
-	memory.valueBits.cmdBits.src = getOpTypeId(line.op1); /* Set the source operand type. */
-	memory.valueBits.cmdBits.opcode = line.cmd->opcode; /* Set the opcode. */
-
-	return memory;
+	if (*memoryCounter < RAM_LIMIT)
+	{
+		memoryArr[(*memoryCounter)++] = memory; /* Add the memory word to the memory array. */
+	}
 }
 
-memoryWord getOpMemoryWord(operandInfo op, boolean isDest)
+boolean addInstructionToMemory(assemblerContext *context, int *memoryCounter, instructionTable *instructions, int index)
 {
-	memoryWord memory = { 0 };
+	int srcMode = instructions->srcModes[index], destMode = instructions->destModes[index];
+	int srcValue = instructions->srcValues[index], destValue = instructions->destValues[index];
+	int lineNum = instructions->lineNums[index];
+	AREKind srcAre, destAre;
+	boolean foundError = FALSE;
 
-	if (op.type == OP_REGULAR_REG)
+	if (!resolveLabelOperand(context, instructions->srcLabels[index], &srcValue, &srcAre, lineNum) || !resolveLabelOperand(context, instructions->destLabels[index], &destValue, &destAre, lineNum))
 	{
-		memory.are = (AREKind)ARE_ABS;
-
-		if (isDest)
-		{
-			memory.valueBits.regBits.destBits = op.value; /* Set the destination register value. */
-		}
-		else
-		{
-			memory.valueBits.regBits.srcBits = op.value; /* Set the source register value. */
-		}
+		foundError = TRUE; /* The destination isn't checked if the source label doesn't exist. */
 	}
-	else if (op.type == OP_INDIRECT_REG)
-	{
-		memory.are = (AREKind)ARE_ABS;
 
-		if (isDest)
-		{
-			memory.valueBits.regBits.destBits = op.value; /* Set the destination indirect register value. */
-		}
-		else
-		{
-			memory.valueBits.regBits.srcBits = op.value; /* Set the source indirect register value. */
-		}
+	addWordToMemory(context->image, memoryCounter, getCmdMemoryWord(instructions->opcodes[index], srcMode, destMode)); /* Add the command memory word to memory. */
+
+	if (srcMode && destMode && g_instructionWords[srcMode][destMode] == 2) /* The command word and a shared operand word. */
+	{
+		addWordToMemory(context->image, memoryCounter, getOpMemoryWord(srcMode, srcValue, srcAre, FALSE) | getOpMemoryWord(destMode, destValue, destAre, TRUE)); /* Two registers share a single memory word. */
 	}
 	else
 	{
-		labelInfo *label = getLabel(op.str);
-
-		if (op.type == OP_LABEL && label && label->isExtern)
+		if (srcMode)
 		{
-			memory.are = ARE_EXT; /* Set the ARE type to external if the label is external. */
+			addWordToMemory(context->image, memoryCounter, getOpMemoryWord(srcMode, srcValue, srcAre, FALSE)); /* Add the source operand memory word to memory. */
 		}
-		else
+
+		if (destMode)
 		{
-			memory.are = (op.type == OP_NUMERIC) ? (AREKind)ARE_ABS : (AREKind)ARE_RELOC; /* Set ARE type based on operand type. */
+			addWordToMemory(context->image, memoryCounter, getOpMemoryWord(destMode, destValue, destAre, TRUE)); /* Add the destination operand memory word to memory. */
 		}
-
-		memory.valueBits.value = op.value; /* Set the operand value. */
 	}
 
-	return memory;
+	return !foundError; /* Return true if no error was found. */
 }
 
-void addWordToMemory(int *memoryArr, int *memoryCounter, memoryWord memory)
+void emitOperandWord(fixupList *fixups, int index, operandInfo *op, boolean isDest, int lineNum)
 {
-	if (*memoryCounter < RAM_LIMIT)
+	if (op->type == OP_LABEL)
 	{
-		memoryArr[(*memoryCounter)++] = getNumFromMemoryWord(memory); /* Add the memory word to the memory array. */
+		addFixup(fixups, index, op->label, lineNum); /* The word is written when the address of the label is known. */
+		return;
 	}
+
+	fixups->memoryArr[index] = getOpMemoryWord(op->type, op->value, (AREKind)ARE_ABS, isDest);
 }
 
-boolean addLineToMemory(int *memoryArr, int *memoryCounter, lineInfo *line)
+void emitInstruction(fixupList *fixups, lineInfo *line)
 {
-	boolean foundError = FALSE;
-
-	if (!line->isError && line->cmd != NULL)
-	{
-		if (!updateLabelOpAddress(&line->op1, line->lineNum) || !updateLabelOpAddress(&line->op2, line->lineNum))
-		{
-			line->isError = TRUE;
-			foundError = TRUE; /* Mark the line as an error if label update fails. */
-		}
-
-		addWordToMemory(memoryArr, memoryCounter, getCmdMemoryWord(*line)); /* Add the command memory word to memory. */
-
-		if (line->op1.type == OP_REGULAR_REG && line->op2.type == OP_REGULAR_REG)
-		{
-			memoryWord memory = { 0 };
-			memory.are = (AREKind)ARE_ABS;
-			memory.valueBits.regBits.destBits = line->op2.value;
-			memory.valueBits.regBits.srcBits = line->op1.value;
+	int index = line->address - INITIAL_ADDRESS, srcMode = getOpMode(line->op1.type), destMode = getOpMode(line->op2.type);
 
-			addWordToMemory(memoryArr, memoryCounter, memory); /* Add register operand memory word. */
-		}
-		else if (line->op1.type == OP_REGULAR_REG && line->op2.type == OP_INDIRECT_REG)
-		{
-			memoryWord memory = { 0 };
-			memory.are = (AREKind)ARE_ABS;
-			memory.valueBits.regBits.destBits = line->op2.value;
-			memory.valueBits.regBits.srcBits = line->op1.value;
+	fixups->memoryArr[index] = getCmdMemoryWord(line->cmd->opcode, srcMode, destMode); /* The first pass already reserved the words. */
 
-			addWordToMemory(memoryArr, memoryCounter, memory); /* Add indirect register operand memory word. */
-		}
-		else if (line->op1.type == OP_INDIRECT_REG && line->op2.type == OP_REGULAR_REG)
-		{
-			memoryWord memory = { 0 };
-			memory.are = (AREKind)ARE_ABS;
-			memory.valueBits.regBits.destBits = line->op2.value;
-			memory.valueBits.regBits.srcBits = line->op1.value;
+	if (srcMode && destMode && g_instructionWords[srcMode][destMode] == 2) /* The command word and a shared operand word. */
+	{
+		fixups->memoryArr[index + 1] = getOpMemoryWord(srcMode, line->op1.value, (AREKind)ARE_ABS, FALSE) | getOpMemoryWord(destMode, line->op2.value, (AREKind)ARE_ABS, TRUE);
+		return;
+	}
 
-			addWordToMemory(memoryArr, memoryCounter, memory); /* Add indirect register operand memory word. */
-		}
-		else if (line->op1.type == OP_INDIRECT_REG && line->op2.type == OP_INDIRECT_REG)
-		{
-			memoryWord memory = { 0 };
-			memory.are = (AREKind)ARE_ABS;
-			memory.valueBits.regBits.destBits = line->op2.value;
-			memory.valueBits.regBits.srcBits = line->op1.value;
+	if (srcMode)
+	{
+		emitOperandWord(fixups, index + 1, &line->op1, FALSE, line->lineNum);
+	}
 
-			addWordToMemory(memoryArr, memoryCounter, memory); /* Add indirect register operand memory word. */
-		}
-		else
-		{
-			if (line->op1.type != OP_INVALID)
-			{
-				line->op1.address = INITIAL_ADDRESS + *memoryCounter;
-				addWordToMemory(memoryArr, memoryCounter, getOpMemoryWord(line->op1, FALSE)); /* Add operand 1 memory word to memory. */
-			}
+	if (destMode)
+	{
+		emitOperandWord(fixups, index + (srcMode ? 2 : 1), &line->op2, TRUE, line->lineNum);
+	}
+}
 
-			if (line->op2.type != OP_INVALID)
-			{
-				line->op2.address = INITIAL_ADDRESS + *memoryCounter;
-				addWordToMemory(memoryArr, memoryCounter, getOpMemoryWord(line->op2, TRUE)); /* Add operand 2 memory word to memory. */
-			}
-		}
+void addDataToMemory(assemblerContext *context, int *memoryCounter, int DC)
+{
+	if (DC > RAM_LIMIT - *memoryCounter)
+	{
+		DC = RAM_LIMIT - *memoryCounter; /* Only the data that fits is added. */
 	}
 
-	return !foundError; /* Return true if no error was found. */
+	if (DC > 0)
+	{
+		memcpy(&context->image[*memoryCounter], context->data, DC * sizeof(machineWord)); /* The data words were masked when they were parsed. */
+		*memoryCounter += DC;
+	}
 }
 
-void addDataToMemory(int *memoryArr, int *memoryCounter, int DC)
+int secondPass(assemblerContext *context, instructionTable *instructions, int IC, int DC)
 {
-	int i;
-	unsigned int mask = ~0;
-	mask >>= (sizeof(int) * BYTE_LENGTH - WORD_LENGTH);
+	int errorsFound = 0, memoryCounter = 0, i;
+
+	updateDataLabelsAddress(context, IC); /* Update the address of data labels based on IC. */
+
+	errorsFound += countIllegalEntries(context); /* Count illegal entries and update errorsFound. */
 
-	for (i = 0; i < DC; i++)
+	for (i = 0; i < instructions->count; i++)
 	{
-		if (*memoryCounter < RAM_LIMIT)
+		if (!addInstructionToMemory(context, &memoryCounter, instructions, i))
 		{
-			memoryArr[(*memoryCounter)++] = mask & g_arr[i]; /* Add data to memory array with mask applied. */
-		}
-		else
-		{
-			return;
+			errorsFound++; /* Increment errorsFound if adding an instruction to memory fails. */
 		}
 	}
+
+	addDataToMemory(context, &memoryCounter, DC); /* Add data to memory after processing the instructions. */
+
+	return errorsFound; /* Return the total number of errors found. */
 }
 
-int secondPass(int *memoryArr, lineInfo *linesArr, int lineNum, int IC, int DC)
+int patchFixups(assemblerContext *context, fixupList *fixups, int IC, int DC)
 {
-	int errorsFound = 0, memoryCounter = 0, i;
+	int errorsFound = 0, memoryCounter = IC, failedWord = -2, value, i;
+	AREKind are;
+	fixup *patch;
 
-	updateDataLabelsAddress(IC); /* Update the address of data labels based on IC. */
+	updateDataLabelsAddress(context, IC); /* Update the address of data labels based on IC. */
 
-	errorsFound += countIllegalEntries(); /* Count illegal entries and update errorsFound. */
+	errorsFound += countIllegalEntries(context); /* Count illegal entries and update errorsFound. */
 
-	for (i = 0; i < lineNum; i++)
+	for (i = 0; i < fixups->count; i++)
 	{
-		if (!addLineToMemory(memoryArr, &memoryCounter, &linesArr[i]))
+		patch = &fixups->fixups[i];
+		if (patch->wordIndex == failedWord + 1)
+		{
+			continue; /* The source label of the instruction doesn't exist, so its destination isn't checked. */
+		}
+
+		if (!resolveLabelOperand(context, patch->label, &value, &are, patch->lineNum))
 		{
-			errorsFound++; /* Increment errorsFound if adding a line to memory fails. */
+			failedWord = patch->wordIndex;
+			errorsFound++; /* Increment errorsFound once for the instruction. */
+			continue;
 		}
+		fixups->memoryArr[patch->wordIndex] = getOpMemoryWord(OP_LABEL, value, are, FALSE);
 	}
 
-	addDataToMemory(memoryArr, &memoryCounter, DC); /* Add data to memory after processing lines. */
+	addDataToMemory(context, &memoryCounter, DC); /* The data comes after the instructions. */
 
 	return errorsFound; /* Return the total number of errors found. */
 }
\ No newline at end of file
@@ -1,18 +1,34 @@
 #!/bin/bash
 
-rm course_example.am course_example.ob course_example.ent course_example.ext invalid_01.am invalid_02.am
-rm double_macro.ob double_macro.am valid_01.am valid_01.ob valid_02.am valid_02.ob valid_02.ent valid_02.ext
+rm course_example.am course_example.ob course_example.ent course_example.ext invalid_01.am invalid_02.am macro_cycle.txt params_count.txt params_list.txt rept_errors.txt rept_errors.am cond_endif.txt cond_else.txt cond_missing.txt
+rm double_macro.ob double_macro.am valid_01.am valid_01.ob valid_02.am valid_02.ob valid_02.ent valid_02.ext macro_tokens.am macro_tokens.ob macro_lib.ml macro_lib_use.am macro_lib_damaged.ml macro_lib_damaged.am macro_lib_damaged.txt macro_lib_use.ob conditional.am conditional.ob rept.am rept.ob params.am params.ob nested.am nested.ob single_pass.am single_pass.ob single_pass.ent single_pass.ext
 
 ./assembler course_example.as
 ./assembler invalid_01.as
 ./assembler invalid_02.as
+./assembler macro_cycle.as > macro_cycle.txt
+./assembler params_count.as > params_count.txt
+./assembler params_list.as > params_list.txt
+./assembler rept_errors.as > rept_errors.txt
+./assembler cond_endif.as > cond_endif.txt
+./assembler cond_else.as > cond_else.txt
+./assembler cond_missing.as > cond_missing.txt
 
 ./assembler double_macro.as
 ./assembler valid_01.as
 ./assembler valid_02.as
+./assembler macro_tokens.as
+./assembler -c macro_lib -l macro_lib macro_lib_use.as
+head -c 100 macro_lib.ml > macro_lib_damaged.ml
+./assembler -l macro_lib_damaged macro_lib_damaged.as > macro_lib_damaged.txt
+./assembler -D DEBUG conditional.as
+./assembler rept.as
+./assembler params.as
+./assembler nested.as
+./assembler -s single_pass.as
 
 ./checkc.sh
 ./checki.sh
 
-rm course_example.am course_example.ob course_example.ent course_example.ext invalid_01.am invalid_02.am
-rm double_macro.ob double_macro.am valid_01.am valid_01.ob valid_02.am valid_02.ob valid_02.ent valid_02.ext
+rm course_example.am course_example.ob course_example.ent course_example.ext invalid_01.am invalid_02.am macro_cycle.txt params_count.txt params_list.txt rept_errors.txt rept_errors.am cond_endif.txt cond_else.txt cond_missing.txt
+rm double_macro.ob double_macro.am valid_01.am valid_01.ob valid_02.am valid_02.ob valid_02.ent valid_02.ext macro_tokens.am macro_tokens.ob macro_lib.ml macro_lib_use.am macro_lib_damaged.ml macro_lib_damaged.am macro_lib_damaged.txt macro_lib_use.ob conditional.am conditional.ob rept.am rept.ob params.am params.ob nested.am nested.ob single_pass.am single_pass.ob single_pass.ent single_pass.ext
@@ -0,0 +1,11 @@
+; a macro that calls itself through another macro
+macr ping
+inc r1
+pong
+endmacr
+macr pong
+dec r1
+ping
+endmacr
+MAIN: ping
+stop
@@ -0,0 +1,10 @@
+; uses macro_lib_damaged.ml, a copy of macro_lib.ml that was cut short
+macr clear
+clr r1
+endmacr
+MAIN: inc_both
+print_len
+clear
+add_to r3,2
+stop
+LEN: .data 3
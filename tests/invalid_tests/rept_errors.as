@@ -0,0 +1,92 @@
+; wrong .rept blocks
+MAIN: inc r1
+.rept
+inc r1
+.endr
+.rept 4097
+inc r1
+.endr
+.rept 1
+inc r2
+.endr inc r2
+.endr
+; a .endr without .rept
+.endr
+; too many nested blocks
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+.rept 1
+inc r3
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+.endr
+; too many repeated lines
+.rept 4096
+.rept 4096
+; c
+.endr
+.endr
+stop
+; missing .endr
+.rept 2
+dec r5
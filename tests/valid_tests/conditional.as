@@ -0,0 +1,24 @@
+; assembled with -D DEBUG
+MAIN: mov r1, r2
+.ifdef DEBUG
+prn #1
+	.ifndef VERBOSE
+	prn #2
+	.else
+	this line is disabled, so it is never checked or normalized at all, however long it gets
+	.endif
+.else
+prn #3
+.endif
+macr trace
+.ifdef DEBUG
+inc r1
+.endif
+endmacr
+.ifdef trace
+trace
+.endif
+.ifndef DEBUG
+prn #4
+.endif
+stop
@@ -0,0 +1,10 @@
+; uses the macros of macro_lib.ml and one of its own
+macr clear
+clr r1
+endmacr
+MAIN: inc_both
+print_len
+clear
+add_to r3,2
+stop
+LEN: .data 3
@@ -0,0 +1,26 @@
+; macros that call other macros, in any order
+macr save_all
+save r1
+save r2
+endmacr
+macr save reg
+mov reg, r7
+bump
+endmacr
+macr bump
+inc r7
+endmacr
+; parameters are replaced in the lines of the macro and in its call arguments
+macr inner
+inc x
+endmacr
+macr outer x
+inner
+mov x, r1
+save x
+endmacr
+MAIN: save_all
+save r3
+outer r2
+stop
+x: .data 1
@@ -0,0 +1,18 @@
+; unrolled tables and loops
+MAIN: mov r1, r2
+.rept 3
+inc r1
+.rept 2
+.data 7
+.endr
+.endr
+.rept 0
+this body is never read
+.endr
+macr twice
+.rept 2
+prn #5
+.endr
+endmacr
+twice
+stop
@@ -0,0 +1,16 @@
+; assembled with -s, the label operands are patched after the first pass
+.entry MAIN
+.extern OUT
+MAIN: mov LEN, r3
+LOOP: cmp r3, #0
+bne END
+add *r1, r2
+lea STR, *r4
+prn OUT
+jsr OUT
+dec r3
+jmp LOOP
+END: stop
+STR: .string "ab"
+LEN: .data 2, -7
+.entry LEN